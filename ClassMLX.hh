@@ -20,37 +20,55 @@
 #include <Arduino.h>
 #include <i2c_device.h> // Teensy 4.0 i2c library
 
+#include "MLXCalc.hh"
+#include "MLXRecord.hh"
+
 // Device address
 const uint8_t MLX90640_I2CADDR_DEFAULT = 0x33;
 
+const uint32_t MLX90640_I2C_FREQUENCY = 1000000U;
+
+/* I2C error recovery in cycle(): a row that fails is read again on the next call, up to
+ * MLX90640_ROW_RETRIES times per subpage; after that the subpage is abandoned rather than
+ * calculated from a part-filled m_raw. After MLX90640_RESET_AFTER failed transfers in a row,
+ * anywhere, the bus is reset. Recovery from an error therefore takes at most
+ * MLX90640_ROW_RETRIES further calls to cycle(), each one row read (about 0.6 ms at 1 MHz).
+ */
+const uint8_t MLX90640_ROW_RETRIES = 3;
+const uint8_t MLX90640_RESET_AFTER = 8;
+
 // Registers
 const uint16_t MLX90640_DEVICEID1 = 0x2407;
 const uint16_t MLX90640_CONTROL1  = 0x800D;
 const uint16_t MLX90640_STATUS1   = 0x8000;
 
-const float mlx_SCALEALPHA = 0.000001;
-
-enum mlx_Mode {
-  MLX90640_CHESS = 0,
-  MLX90640_INTERLEAVED
+enum mlx_FrameFlags {
+  MLX90640_FRAME_CLEAN     = 0x00,
+  MLX90640_FRAME_TORN      = 0x01, // the sensor overwrote RAM while the subpage was being read
+  MLX90640_FRAME_DROPPED   = 0x02, // one or more subpages were missed before this one
+  MLX90640_FRAME_UNCHECKED = 0x04  // the status couldn't be read after the subpage, so it may be torn
 };
 
-enum mlx_RefreshRate {
-  MLX90640_0_5_HZ = 0,
-  MLX90640_1_HZ,
-  MLX90640_2_HZ,
-  MLX90640_4_HZ,
-  MLX90640_8_HZ,
-  MLX90640_16_HZ,
-  MLX90640_32_HZ,
-  MLX90640_64_HZ
+struct mlx_FrameStats {
+  uint32_t frames;  // subpages processed
+  uint32_t torn;    // subpages flagged MLX90640_FRAME_TORN
+  uint32_t dropped; // subpages flagged MLX90640_FRAME_DROPPED
+  uint32_t missed;  // estimated total number of subpages missed
+  uint32_t errors;  // I2C transfers that failed
+  uint32_t retries; // rows read again after an error
+  uint32_t aborted; // subpages abandoned after too many errors
+  uint32_t resets;  // bus resets
+  uint32_t recovery_max; // longest time from an error in a row to its being read or the subpage abandoned, us
 };
 
-enum mlx_Resolution {
-  MLX90640_ADC_16BIT = 0,
-  MLX90640_ADC_17BIT,
-  MLX90640_ADC_18BIT,
-  MLX90640_ADC_19BIT
+struct mlx_Timing { // all in microseconds
+  uint32_t read;     // reading the subpage over I2C
+  uint32_t calc;     // calculating the temperatures
+  uint32_t interval; // time since the previous subpage
+  uint32_t period;   // nominal time between subpages at the current refresh rate
+  uint32_t capture;  // step mode: from trigger() to the frame being ready
+  uint32_t recovery; // from the last row error to the row being read, or the subpage abandoned
+  uint32_t aux;      // the last update_aux()
 };
 
 static const char *s_hex = "0123456789ABCDEF";
@@ -62,6 +80,13 @@ public:
   const float *get_frame() const { return m_cam; }
 private:
   uint16_t m_raw[32*26];
+  uint16_t m_aux[MLX90640_AUX_WORDS]; // read by update_aux(), so that m_raw is left alone
+  uint16_t m_eeprom[832];
+public:
+  const uint16_t *get_raw() const { return m_raw; }       // RAM image of the last subpage
+  const uint16_t *get_eeprom() const { return m_eeprom; } // EEPROM image, as read by begin()
+  const mlx_Parameters &get_parameters() const { return m_params; } // calibration extracted from the EEPROM
+private:
 
   uint8_t m_buffer[64];
   uint8_t m_address;
@@ -72,48 +97,44 @@ private:
   uint16_t  m_async_word_count;
 
   elapsedMicros m_timer;
+  elapsedMicros m_ready_timer; // time since the last data-ready
+  elapsedMicros m_step_timer;  // time since trigger()
+  elapsedMicros m_recovery_timer; // time since a row read failed
 
   uint16_t m_subpage;
+  uint16_t m_control;   // control register, as last read or written
+
+  uint32_t m_timestamp; // micros() at the last data-ready
 
   int  m_row;
   bool m_bCycling;
   bool m_bCalcT;
+  bool m_bSequenced; // false until the first subpage of a cycling sequence
+  bool m_bStep;      // step mode: measure only on trigger()
+  bool m_bFrameReady; // step mode: both subpages of the triggered frame are in m_cam
+  bool m_bPassthrough; // raw passthrough: the host calculates the pixel temperatures
+
+  uint8_t m_step_subpages; // step mode: bit per subpage captured since trigger()
+  uint8_t m_step_count;    // step mode: subpages read since trigger(); 0 => idle
+
+  uint8_t m_row_errors; // failed row reads in this subpage
+  uint8_t m_bus_errors; // failed transfers in a row
+  bool    m_bRecovering; // a row read failed and hasn't yet succeeded
+
+  uint32_t m_sequence; // subpage sequence number, including missed subpages
+  uint8_t  m_flags;    // mlx_FrameFlags for the current subpage
+
+  mlx_FrameStats m_stats;
+  mlx_Timing     m_timing;
 
   float m_ambient;
+  float m_vdd;
 
   mlx_Mode m_Mode;
   mlx_RefreshRate m_RefreshRate;
   mlx_Resolution m_Resolution;
 
-  struct MLX_Parameters {
-    int16_t  kVdd;
-    int16_t  vdd25;
-    float    KvPTAT;
-    float    KtPTAT;
-    uint16_t vPTAT25;
-    float    alphaPTAT;
-    int16_t  gainEE;
-    float    tgc;
-    float    cpKv;
-    float    cpKta;
-    uint8_t  resolutionEE;
-    uint8_t  calibrationModeEE;
-    float    KsTa;
-    float    ksTo[5];
-    int16_t  ct[5];
-    uint16_t alpha[768];
-    uint8_t  alphaScale;
-    int16_t  offset[768];
-    int8_t   kta[768];
-    uint8_t  ktaScale;
-    int8_t   kv[768];
-    uint8_t  kvScale;
-    float    cpAlpha[2];
-    int16_t  cpOffset[2];
-    float    ilChessC[3];
-    uint16_t brokenPixels[5];
-    uint16_t outlierPixels[5];
-  } m_params;
+  mlx_Parameters m_params;
 public:
   MLX(I2CMaster &i2c, uint8_t address = MLX90640_I2CADDR_DEFAULT) :
     m_address(address),
@@ -121,15 +142,37 @@ public:
     m_async_word_buffer(0),
     m_async_word_count(0),
     m_subpage(0),
+    m_control(0),
+    m_timestamp(0),
     m_row(26),
     m_bCycling(false),
     m_bCalcT(false),
+    m_bSequenced(false),
+    m_bStep(false),
+    m_bFrameReady(false),
+    m_bPassthrough(false),
+    m_step_subpages(0),
+    m_step_count(0),
+    m_row_errors(0),
+    m_bus_errors(0),
+    m_bRecovering(false),
+    m_sequence(0),
+    m_flags(MLX90640_FRAME_CLEAN),
     m_ambient(0.0),
+    m_vdd(0.0),
     m_Mode(MLX90640_CHESS),
     m_RefreshRate(MLX90640_2_HZ),
     m_Resolution(MLX90640_ADC_19BIT)
   {
-    // ...
+    reset_stats();
+
+    m_timing.read = 0;
+    m_timing.calc = 0;
+    m_timing.interval = 0;
+    m_timing.period = subpage_period();
+    m_timing.capture = 0;
+    m_timing.recovery = 0;
+    m_timing.aux = 0;
   }
   ~MLX() {
     // ...
@@ -137,9 +180,43 @@ public:
   float get_ambient() const { // last calculated ambient temperature
     return m_ambient;
   }
+  float get_vdd() const { // last calculated supply voltage
+    return m_vdd;
+  }
+  uint8_t get_frame_flags() const { // mlx_FrameFlags for the last subpage
+    return m_flags;
+  }
+  uint32_t get_sequence() const { // sequence number of the last subpage
+    return m_sequence;
+  }
+  const mlx_FrameStats &get_stats() const {
+    return m_stats;
+  }
+  const mlx_Timing &get_timing() const { // timing of the last subpage
+    return m_timing;
+  }
+  uint16_t get_subpage() const {
+    return m_subpage;
+  }
+  uint32_t get_timestamp() const { // micros() at data-ready for the last subpage
+    return m_timestamp;
+  }
+
+  void record_header(mlx_RecordHeader &header) const; // fill in a raw-frame log header
+  void record_frame(mlx_RecordFrame &frame) const;    // ... and a log entry for the last subpage
+  void reset_stats() {
+    m_stats.frames  = 0;
+    m_stats.torn    = 0;
+    m_stats.dropped = 0;
+    m_stats.missed  = 0;
+    m_stats.errors  = 0;
+    m_stats.retries = 0;
+    m_stats.aborted = 0;
+    m_stats.resets  = 0;
+    m_stats.recovery_max = 0;
+  }
 private:
   int read_eeprom(); // returns non-zero if adjacent bad pixels
-  int check_adjacent(uint16_t pix1, uint16_t pix2);
 
   float get_Vdd();
   float calculate_ambient(float vdd);
@@ -147,7 +224,7 @@ private:
 
 public:
   void begin() {
-    m_i2c.begin(1000000U);
+    m_i2c.begin(MLX90640_I2C_FREQUENCY);
     read_eeprom();
     m_Mode = get_mode();
     m_RefreshRate = get_refresh_rate();
@@ -173,7 +250,7 @@ private:
     m_i2c.write_async(m_address, m_buffer, 2, false);
     while (!m_i2c.finished());
     if (m_i2c.has_error()) {
-      Serial.print("[i2c-write-error]");
+      i2c_failed();
       return false;
     }
 
@@ -192,8 +269,9 @@ private:
 
     bool bReadError = m_i2c.has_error();
     if (bReadError) {
-      Serial.print("[i2c-read-error]");
+      i2c_failed();
     } else {
+      m_bus_errors = 0;
       uint8_t *ptr = m_buffer;
       for (int i = 0; i < m_async_word_count; i++) {
 	uint16_t hi = *ptr++;
@@ -210,7 +288,13 @@ private:
     if (!i2c_read_async_begin(regaddr, word_buffer, word_count)) {
       return false;
     }
-    return i2c_read_async_end();
+    if (!i2c_read_async_end()) {
+      return false;
+    }
+    if (regaddr == MLX90640_CONTROL1) {
+      m_control = *word_buffer;
+    }
+    return true;
   }
   bool i2c_write_sync(uint16_t regaddr, uint16_t *word_buffer, uint16_t word_count = 1) {
     if (!word_count || !word_buffer || i2c_busy()) return false;
@@ -231,11 +315,19 @@ private:
     m_i2c.write_async(m_address, m_buffer, byte_count, true);
     while (!m_i2c.finished());
     if (m_i2c.has_error()) {
-      Serial.print("[i2c-write-error]");
+      i2c_failed();
       return false;
     }
+    m_bus_errors = 0;
+    if (regaddr == MLX90640_CONTROL1) {
+      m_control = *word_buffer;
+    }
     return true;
   }
+  void i2c_failed() {
+    ++m_stats.errors;
+    if (m_bus_errors < 255) ++m_bus_errors;
+  }
   bool data_ready(uint16_t &subpage) {
     static uint16_t regaddr = MLX90640_STATUS1;
     uint16_t regvalue = 0;
@@ -247,10 +339,95 @@ private:
     }
     return false;
   }
-  void clear_data_ready() { // allow the device RAM to update
+  bool clear_data_ready(bool bStart = true) { // allow the device RAM to update; in step mode, bStart measures the next subpage
     const uint16_t regaddr = MLX90640_STATUS1;
-    uint16_t regvalue = 0x0030;
-    i2c_write_sync(regaddr, &regvalue);
+    uint16_t regvalue = bStart ? 0x0030 : 0x0010;
+    return i2c_write_sync(regaddr, &regvalue);
+  }
+  uint32_t subpage_period() const { // nominal time between subpages, in microseconds
+    return 2000000UL >> m_RefreshRate;
+  }
+  void check_sequence(uint16_t subpage) { // called on data-ready, before m_subpage is updated
+    uint32_t missed = 0;
+    uint32_t dt = m_ready_timer;
+
+    if (m_bSequenced) {
+      uint32_t period = subpage_period();
+
+      missed = (dt + period / 2) / period; // number of subpage periods since the last one
+      if (missed) --missed;
+
+      /* The subpages alternate, so a repeated subpage means an odd number were missed;
+       * the parity is more reliable than the timing, which depends on how often we poll.
+       */
+      if (subpage == m_subpage) {
+	if (!(missed & 1)) ++missed;
+      } else {
+	if (missed & 1) --missed;
+      }
+    }
+    m_ready_timer = 0;
+    m_bSequenced = true;
+
+    m_timing.interval = dt;
+    m_timing.period = subpage_period();
+
+    m_sequence += 1 + missed;
+    m_flags = missed ? MLX90640_FRAME_DROPPED : MLX90640_FRAME_CLEAN;
+
+    if (missed) {
+      ++m_stats.dropped;
+      m_stats.missed += missed;
+    }
+  }
+  void row_failed() { // a row read failed: read it again, or abandon the subpage
+    if (!m_bRecovering) {
+      m_bRecovering = true;
+      m_recovery_timer = 0;
+    }
+    if (++m_row_errors <= MLX90640_ROW_RETRIES) {
+      ++m_stats.retries;
+      return;
+    }
+    ++m_stats.aborted;
+    m_row = 26; // wait for the next subpage
+    end_recovery();
+  }
+  void end_recovery() { // the failed row has been read, or the subpage abandoned
+    if (m_bRecovering) {
+      m_timing.recovery = m_recovery_timer;
+      if (m_stats.recovery_max < m_timing.recovery) {
+	m_stats.recovery_max = m_timing.recovery;
+      }
+      m_bRecovering = false;
+    }
+  }
+  void reset_bus() {
+    m_i2c.end();
+    m_i2c.begin(MLX90640_I2C_FREQUENCY);
+    m_async_word_buffer = 0;
+    m_async_word_count  = 0;
+    m_bus_errors = 0;
+    ++m_stats.resets;
+  }
+  void check_overwrite() { // called once all rows are read
+    const uint16_t regaddr = MLX90640_STATUS1;
+    uint16_t regvalue = 0;
+    if (!i2c_read_sync(regaddr, &regvalue) && !i2c_read_sync(regaddr, &regvalue)) {
+      m_flags |= MLX90640_FRAME_UNCHECKED; // can't tell; the failures are counted as errors, not as torn
+      return;
+    }
+    if (!(regvalue & 0x0008)) {
+      return; // nothing new since data-ready was cleared
+    }
+    /* Data-ready is set again (leave it for cycle()). If the status names the other subpage,
+     * the sensor wrote it into RAM during the read. If it names the same subpage, either both
+     * subpages have been written since, which takes two subpage periods, or the flag is stale.
+     */
+    if ((regvalue & 0x0001) != m_subpage || (uint32_t) m_ready_timer >= 2 * subpage_period()) {
+      m_flags |= MLX90640_FRAME_TORN;
+      ++m_stats.torn;
+    }
   }
 public:
   void set_mode(mlx_Mode mode) {
@@ -282,6 +459,7 @@ public:
     regvalue |= static_cast<uint16_t>(rate) << 7;
     i2c_write_sync(regaddr, &regvalue);
     m_RefreshRate = get_refresh_rate();
+    m_bSequenced = false; // the subpage period has changed
   }
   mlx_RefreshRate get_refresh_rate() {
     const uint16_t regaddr = MLX90640_CONTROL1;
@@ -291,6 +469,9 @@ public:
     return static_cast<mlx_RefreshRate>(regvalue);
   }
   const char *refresh_rate_description(mlx_RefreshRate rate) const;
+  mlx_RefreshRate cached_refresh_rate() const { // as last read or set, without a bus transaction
+    return m_RefreshRate;
+  }
 
   void set_resolution(mlx_Resolution resolution) {
     const uint16_t regaddr = MLX90640_CONTROL1;
@@ -309,6 +490,9 @@ public:
     return static_cast<mlx_Resolution>(regvalue);
   }
   const char *resolution_description(mlx_Resolution resolution) const;
+  mlx_Resolution cached_resolution() const {
+    return m_Resolution;
+  }
 
   const char *get_serial_number() {
     static char sno[13];
@@ -329,10 +513,80 @@ public:
 
     return sno;
   }
+  /* Step (single-shot) mode: the sensor measures only when triggered, so there is no
+   * conversion and no polling between captures. trigger() starts a frame; cycle() reads
+   * and calculates both subpages back-to-back (the start bit is set again on the first
+   * data-ready) and frame_ready() becomes true once both are in get_frame(). Needs
+   * cycle_mode(true) as usual.
+   */
+  void step_mode(bool step) {
+    const uint16_t regaddr = MLX90640_CONTROL1;
+    uint16_t regvalue = 0;
+    if (i2c_read_sync(regaddr, &regvalue)) {
+      if (step) {
+	regvalue |= 0x0002;
+      } else {
+	regvalue &= ~0x0002;
+      }
+      i2c_write_sync(regaddr, &regvalue);
+    }
+    m_bStep = step;
+    m_step_count = 0;
+    m_bSequenced = false;
+  }
+  bool get_step_mode() const {
+    return m_bStep;
+  }
+  bool trigger() { // step mode: start a frame; false if not in step mode, or still capturing
+    if (!m_bStep || m_step_count || m_row != 26 || m_bCalcT) return false;
+
+    m_bFrameReady = false;
+    m_bSequenced = false;
+    m_step_subpages = 0;
+    m_step_count = 1;
+    m_step_timer = 0;
+    clear_data_ready(true); // sets the start-of-measurement bit
+    return true;
+  }
+  bool frame_ready() const { // step mode: the frame from the last trigger() is complete
+    return m_bFrameReady;
+  }
+  /* Ambient temperature and Vdd only: read the 64 auxiliary words (two transfers instead of
+   * 26, and no pixel conversion) into a buffer of their own, so get_raw() and get_frame()
+   * are untouched. Meant for monitoring at a lower cadence, between subpages while cycling
+   * or with cycling off; the values are those of the sensor's last measured subpage.
+   * Returns false if a subpage is being read (try again later) or a transfer fails.
+   */
+  bool update_aux() {
+    if (m_bCycling && (m_row != 26 || m_bCalcT || m_step_count)) return false;
+    if (i2c_busy() || i2c_async_in_progress()) return false;
+
+    elapsedMicros aux_timer;
+    for (uint16_t offset = 0; offset < MLX90640_AUX_WORDS; offset += 32) {
+      if (!i2c_read_sync(0x0400 + MLX90640_AUX_FIRST + offset, m_aux + offset, 32)) {
+	return false;
+      }
+    }
+    m_vdd = mlx_aux_Vdd(&m_params, m_aux, m_Resolution);
+    m_ambient = mlx_aux_ambient(&m_params, m_aux, m_vdd);
+    m_timing.aux = aux_timer;
+    return true;
+  }
+  /* Raw passthrough: cycle() reads every subpage as usual, but calculates only the ambient
+   * temperature and Vdd, leaving the pixels to the host (see MLXPacket.hh), so get_frame()
+   * is not updated. Stats, timing and get_ambient() carry on as before.
+   */
+  void passthrough_mode(bool bPassthrough) {
+    m_bPassthrough = bPassthrough;
+  }
+  bool get_passthrough_mode() const {
+    return m_bPassthrough;
+  }
   void cycle_mode(bool cycling) {
     if (cycling && !m_bCycling) {
       m_row = 26;
       m_bCalcT = false;
+      m_bSequenced = false;
     }
     m_bCycling = cycling;
   }
@@ -340,36 +594,75 @@ public:
     if (!m_bCycling) return false; // we're not in cycling mode
     if (i2c_busy())  return false; // come back later...
 
+    if (m_bus_errors >= MLX90640_RESET_AFTER) {
+      reset_bus();
+    }
+
     if (m_bCalcT) { // end of cycle
       m_bCalcT = false;
-      calculate_temperatures();
+      elapsedMicros calc_timer;
+      if (m_bPassthrough) {
+	calculate_ambient(get_Vdd()); // the pixels are left to the host
+      } else {
+	calculate_temperatures();
+      }
+      m_timing.calc = calc_timer;
+      ++m_stats.frames;
+      if (m_bStep && m_step_count && (m_step_subpages == 3 || m_step_count == 4)) { // done, or given up
+	m_bFrameReady = (m_step_subpages == 3);
+	m_timing.capture = m_step_timer;
+	m_step_count = 0;
+      }
       if (dt) *dt = m_timer;
       return true;
     }
 	
     if (i2c_async_in_progress()) { // finish what we started
-      i2c_read_async_end();
-
+      if (!i2c_read_async_end()) {
+	row_failed();    // the row is read again next time, unless the subpage is abandoned
+	return false;
+      }
+      end_recovery();
       if (++m_row == 26) {
+	m_timing.read = m_timer;
+	check_overwrite();
 	m_bCalcT = true; // this is the last read; next time calculate the temperatures
 	return false;
       }
     }
 
     if (m_row == 26) {   // we're waiting for new data
+      if (m_bStep && !m_step_count) {
+	return false;    // step mode, and nothing triggered: leave the bus alone
+      }
       uint16_t subpage = 0;
       if (data_ready(subpage)) {
-	clear_data_ready();
+	bool bStart = true; // in step mode, measure the other subpage straight away, unless this completes the frame
+	if (m_bStep) {
+	  bStart = ((m_step_subpages | 1 << subpage) != 3) && (m_step_count < 4);
+	}
+	if (!clear_data_ready(bStart)) {
+	  return false;  // data-ready is still set, so try again next time
+	}
+	m_timestamp = micros();
+	if (m_bStep) {
+	  m_step_subpages |= 1 << subpage;
+	  ++m_step_count;
+	}
+	check_sequence(subpage);
 	m_subpage = subpage;
 	m_row = 0;       // now we're ready to collect
+	m_row_errors = 0;
       }
     } else {
-      if (!m_row) {      // starting a new collection sequence; reset the timer
+      if (!m_row && !m_bRecovering) { // starting a new collection sequence; reset the timer
 	m_timer = 0;
       }
       uint16_t *rowdata = m_raw  + (m_row << 5);
       uint16_t  regaddr = 0x0400 + (m_row << 5);
-      i2c_read_async_begin(regaddr, rowdata, 32);
+      if (!i2c_read_async_begin(regaddr, rowdata, 32)) {
+	row_failed();
+      }
     }
     return false;
   }
@@ -0,0 +1,122 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MLXAlarm.hh"
+
+bool MLXAlarms::add(const mlx_AlarmRule &rule) {
+  if (!rule.id || !rule.count || rule.col_min > rule.col_max || rule.col_max > 31 || rule.row_min > rule.row_max || rule.row_max > 23) {
+    return false;
+  }
+  int index = 0;
+  while (index < m_count && m_rule[index].id != rule.id) {
+    ++index;
+  }
+  if (index == mlx_AlarmRules) {
+    return false;
+  }
+  if (index == m_count) {
+    ++m_count;
+  }
+  m_rule[index] = rule;
+
+  m_state[index].bActive   = false;
+  m_state[index].bChanging = false;
+  m_state[index].since     = 0;
+
+  return true;
+}
+
+bool MLXAlarms::remove(uint8_t id) {
+  for (int index = 0; index < m_count; index++) {
+    if (m_rule[index].id == id) {
+      for (--m_count; index < m_count; index++) { // keep the order
+	m_rule[index]  = m_rule[index + 1];
+	m_state[index] = m_state[index + 1];
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+bool MLXAlarms::set_threshold(uint8_t id, float threshold) {
+  for (int index = 0; index < m_count; index++) {
+    if (m_rule[index].id == id) {
+      m_rule[index].threshold = threshold; // an active alarm stays active until evaluate() clears it, with an event
+      return true;
+    }
+  }
+  return false;
+}
+
+int MLXAlarms::evaluate(const float *frame, uint32_t timestamp, mlx_AlarmEvent *events) {
+  int count = 0;
+
+  for (int index = 0; index < m_count; index++) {
+    const mlx_AlarmRule &R = m_rule[index];
+    State &S = m_state[index];
+
+    /* While inactive, count pixels beyond the threshold; while active, beyond the
+     * threshold less the hysteresis. Compare -T for BELOW so that one test serves both.
+     */
+    float sign  = (R.type == MLX90640_ALARM_BELOW) ? -1 : 1;
+    float limit = sign * R.threshold - (S.bActive ? R.hysteresis : 0);
+
+    uint16_t beyond = 0;
+    float peak = sign * frame[R.row_min * 32 + R.col_min];
+    uint8_t peak_row = R.row_min;
+    uint8_t peak_col = R.col_min;
+
+    for (uint8_t row = R.row_min; row <= R.row_max; row++) {
+      const float *T = frame + row * 32;
+      for (uint8_t col = R.col_min; col <= R.col_max; col++) {
+	float t = sign * T[col];
+	if (t > limit) {
+	  ++beyond;
+	}
+	if (t > peak) {
+	  peak = t;
+	  peak_row = row;
+	  peak_col = col;
+	}
+      }
+    }
+
+    bool bChange = S.bActive ? (beyond < R.count) : (beyond >= R.count);
+
+    if (!bChange) {
+      S.bChanging = false;
+      continue;
+    }
+    if (!S.bChanging) {
+      S.bChanging = true;
+      S.since = timestamp;
+    }
+    if ((timestamp - S.since) / 1000 < R.persist) {
+      continue;
+    }
+    S.bActive = !S.bActive;
+    S.bChanging = false;
+
+    mlx_AlarmEvent &E = events[count++];
+    E.timestamp = timestamp;
+    E.id        = R.id;
+    E.bActive   = S.bActive;
+    E.row       = peak_row;
+    E.col       = peak_col;
+    E.count     = beyond;
+    E.peak      = sign * peak;
+  }
+  return count;
+}
@@ -0,0 +1,104 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MLXAlarm_HH
+#define MLXAlarm_HH
+
+#include <stdint.h>
+
+enum mlx_AlarmType {
+  MLX90640_ALARM_ABOVE = 0, // pixels hotter than the threshold
+  MLX90640_ALARM_BELOW      // pixels colder than the threshold
+};
+
+struct mlx_AlarmRule {
+  uint8_t  id;         // reported in events; 0 is not used
+  uint8_t  type;       // mlx_AlarmType
+  uint8_t  col_min;    // region of interest, inclusive: columns 0-31, rows 0-23
+  uint8_t  col_max;
+  uint8_t  row_min;
+  uint8_t  row_max;
+  uint16_t count;      // pixels beyond the threshold needed to raise the alarm
+  float    threshold;  // degC
+  float    hysteresis; // degC; the alarm clears once fewer than count pixels are beyond threshold -/+ hysteresis
+  uint32_t persist;    // ms that either condition must hold before the alarm changes state
+};
+
+struct mlx_AlarmEvent {
+  uint32_t timestamp; // as passed to evaluate()
+  uint8_t  id;
+  bool     bActive;   // raised (true) or cleared (false)
+  uint8_t  row;       // location of the peak
+  uint8_t  col;
+  uint16_t count;     // pixels beyond the threshold (or, on clearing, beyond threshold -/+ hysteresis)
+  float    peak;      // hottest (ABOVE) or coldest (BELOW) pixel in the region, degC
+};
+
+const int mlx_AlarmRules = 8;
+
+/* Threshold alarms over a merged frame (MLX::get_frame()).
+ *
+ * Call evaluate() each time MLX::cycle() returns true; it looks only at the pixels in each
+ * rule's region and returns the rules that changed state, so that only events need be
+ * sent. A rule is raised once at least count pixels have been beyond the threshold for
+ * persist ms, and cleared once fewer than count have been beyond the threshold less the
+ * hysteresis for persist ms.
+ */
+class MLXAlarms {
+private:
+  mlx_AlarmRule m_rule[mlx_AlarmRules];
+
+  struct State {
+    bool     bActive;
+    bool     bChanging; // the condition for changing state holds...
+    uint32_t since;     // ... since this time
+  } m_state[mlx_AlarmRules];
+
+  int m_count;
+
+public:
+  MLXAlarms() :
+    m_count(0)
+  {
+    // ...
+  }
+
+  ~MLXAlarms() {
+    // ...
+  }
+
+  bool add(const mlx_AlarmRule &rule); // replaces any rule with the same id; false if full or invalid
+  bool remove(uint8_t id);
+  bool set_threshold(uint8_t id, float threshold); // in place, keeping the rule's state; false if no such rule
+  void clear() {
+    m_count = 0;
+  }
+
+  int count() const {
+    return m_count;
+  }
+  const mlx_AlarmRule &rule(int index) const {
+    return m_rule[index];
+  }
+  bool active(int index) const {
+    return m_state[index].bActive;
+  }
+
+  /* timestamp is in microseconds, e.g., MLX::get_timestamp(); events must have room for
+   * mlx_AlarmRules events. Returns the number of events.
+   */
+  int evaluate(const float *frame, uint32_t timestamp, mlx_AlarmEvent *events);
+};
+
+#endif // MLXAlarm_HH
@@ -0,0 +1,175 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MLXBlobs.hh"
+
+MLXBlobs::MLXBlobs() :
+  m_bBackground(false),
+  m_count(0),
+  m_rule(MLX90640_BLOB_THRESHOLD),
+  m_threshold(30),
+  m_rate(0.05f),
+  m_min_area(2)
+{
+  // ...
+}
+
+uint16_t MLXBlobs::find(uint16_t label) {
+  while (m_label[label].parent != label) {
+    m_label[label].parent = m_label[m_label[label].parent].parent; // path halving
+    label = m_label[label].parent;
+  }
+  return label;
+}
+
+uint16_t MLXBlobs::join(uint16_t a, uint16_t b) { // merge the sets of a and b; returns the root
+  a = find(a);
+  b = find(b);
+  if (a == b) return a;
+
+  if (a > b) { // keep the older label as the root
+    uint16_t c = a;
+    a = b;
+    b = c;
+  }
+  Label &A = m_label[a];
+  const Label &B = m_label[b];
+
+  A.area    += B.area;
+  A.sum_col += B.sum_col;
+  A.sum_row += B.sum_row;
+  if (A.col_min > B.col_min) A.col_min = B.col_min;
+  if (A.col_max < B.col_max) A.col_max = B.col_max;
+  if (A.row_min > B.row_min) A.row_min = B.row_min;
+  if (A.row_max < B.row_max) A.row_max = B.row_max;
+  if (A.peak < B.peak) {
+    A.peak = B.peak;
+    A.peak_col = B.peak_col;
+    A.peak_row = B.peak_row;
+  }
+  m_label[b].parent = a;
+  return a;
+}
+
+void MLXBlobs::update_background(const float *frame) { // background pixels only, so hot objects don't fade in
+  if (!m_bBackground) {
+    for (int p = 0; p < 768; p++) {
+      m_background[p] = frame[p];
+    }
+    m_bBackground = true;
+    return;
+  }
+  for (int p = 0; p < 768; p++) {
+    if (frame[p] <= m_background[p] + m_threshold) {
+      m_background[p] += m_rate * (frame[p] - m_background[p]);
+    }
+  }
+}
+
+int MLXBlobs::detect(const float *frame) {
+  bool bBackground = (m_rule == MLX90640_BLOB_BACKGROUND);
+  if (bBackground && !m_bBackground) {
+    update_background(frame); // first frame: everything is background
+  }
+
+  uint16_t labels = 0;
+
+  for (int col = 0; col < 32; col++) {
+    m_prev[col] = 0;
+  }
+  for (uint8_t row = 0; row < 24; row++) {
+    uint16_t left = 0;
+
+    for (uint8_t col = 0; col < 32; col++) {
+      int p = row * 32 + col;
+      float t = frame[p];
+      float limit = bBackground ? (m_background[p] + m_threshold) : m_threshold;
+
+      if (!(t > limit)) { // NaN counts as background
+	left = 0;
+	m_prev[col] = 0;
+	continue;
+      }
+      uint16_t up = m_prev[col];
+      uint16_t label;
+
+      if (left && up) {
+	label = join(left, up);
+      } else if (left || up) {
+	label = find(left ? left : up);
+      } else {
+	label = ++labels;
+	Label &L = m_label[label];
+	L.parent  = label;
+	L.area    = 0;
+	L.sum_col = 0;
+	L.sum_row = 0;
+	L.col_min = L.col_max = col;
+	L.row_min = L.row_max = row;
+	L.peak_col = col;
+	L.peak_row = row;
+	L.peak = t;
+      }
+      Label &L = m_label[label];
+      ++L.area;
+      L.sum_col += col;
+      L.sum_row += row;
+      if (L.col_min > col) L.col_min = col;
+      if (L.col_max < col) L.col_max = col;
+      if (L.row_max < row) L.row_max = row;
+      if (L.peak < t) {
+	L.peak = t;
+	L.peak_col = col;
+	L.peak_row = row;
+      }
+      left = label;
+      m_prev[col] = label;
+    }
+  }
+
+  m_count = 0;
+
+  for (uint16_t label = 1; label <= labels; label++) {
+    const Label &L = m_label[label];
+    if (L.parent != label || L.area < m_min_area) continue;
+
+    int index = m_count; // insert, largest first
+    if (index == mlx_MaxBlobs) {
+      if (m_blob[index - 1].area >= L.area) continue;
+      --index;
+    } else {
+      ++m_count;
+    }
+    while (index > 0 && m_blob[index - 1].area < L.area) {
+      m_blob[index] = m_blob[index - 1];
+      --index;
+    }
+    mlx_Blob &B = m_blob[index];
+    B.area     = L.area;
+    B.col_min  = L.col_min;
+    B.col_max  = L.col_max;
+    B.row_min  = L.row_min;
+    B.row_max  = L.row_max;
+    B.peak_col = L.peak_col;
+    B.peak_row = L.peak_row;
+    B.col      = (float) L.sum_col / L.area;
+    B.row      = (float) L.sum_row / L.area;
+    B.peak     = L.peak;
+  }
+
+  if (bBackground) {
+    update_background(frame);
+  }
+  return m_count;
+}
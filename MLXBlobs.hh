@@ -0,0 +1,123 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MLXBlobs_HH
+#define MLXBlobs_HH
+
+#include <stdint.h>
+
+enum mlx_BlobRule {
+  MLX90640_BLOB_THRESHOLD = 0, // foreground: T > threshold
+  MLX90640_BLOB_BACKGROUND     // foreground: T > background + threshold, background a running average
+};
+
+struct mlx_Blob {
+  uint16_t area;     // pixels
+  uint8_t  col_min;  // bounding box, inclusive
+  uint8_t  col_max;
+  uint8_t  row_min;
+  uint8_t  row_max;
+  uint8_t  peak_col; // location of the hottest pixel
+  uint8_t  peak_row;
+  float    col;      // centroid
+  float    row;
+  float    peak;     // degC
+};
+
+const int mlx_MaxBlobs = 16; // largest blobs kept per frame
+
+/* Hot-spot detection: 4-connected labelling of the foreground pixels of a merged frame in
+ * a single raster pass, with union-find over provisional labels and the statistics of each
+ * label merged as labels are joined, so no label image is kept - only the labels of the
+ * previous row.
+ *
+ * Memory is fixed (about 12 KB, most of it the background, plus the statistics for the
+ * at most 384 provisional labels a 32x24 frame can need). Time is one pass over the 768
+ * pixels, with path-halving finds, and a pass over the labels; about 5.5 us per frame on
+ * a desktop for a random half-hot frame, and budgeted at 100 us on the teensy 4, i.e.,
+ * well inside the 15.6 ms subpage period at 64 Hz. The ircamlx sketch reports the time.
+ */
+class MLXBlobs {
+private:
+  struct Label {
+    uint16_t parent;
+    uint16_t area;
+    uint16_t sum_col;
+    uint16_t sum_row;
+    uint8_t  col_min;
+    uint8_t  col_max;
+    uint8_t  row_min;
+    uint8_t  row_max;
+    uint8_t  peak_col;
+    uint8_t  peak_row;
+    float    peak;
+  } m_label[385];         // label 0 is the background
+
+  uint16_t m_prev[32];    // labels of the previous row
+
+  float m_background[768];
+  bool  m_bBackground;    // m_background has been initialised
+
+  mlx_Blob m_blob[mlx_MaxBlobs];
+  int      m_count;
+
+  mlx_BlobRule m_rule;
+  float    m_threshold;   // degC, or degC above the background
+  float    m_rate;        // background update rate per frame, 0-1
+  uint16_t m_min_area;    // smaller blobs are ignored
+
+public:
+  MLXBlobs();
+
+  ~MLXBlobs() {
+    // ...
+  }
+
+  void set_threshold(float threshold) { // fixed threshold, degC
+    m_rule = MLX90640_BLOB_THRESHOLD;
+    m_threshold = threshold;
+  }
+  void set_background(float delta, float rate = 0.05f) { // delta degC above a running-average background
+    m_rule = MLX90640_BLOB_BACKGROUND;
+    m_threshold = delta;
+    m_rate = rate;
+    m_bBackground = false;
+  }
+  void set_min_area(uint16_t area) {
+    m_min_area = area;
+  }
+
+  mlx_BlobRule get_rule() const {
+    return m_rule;
+  }
+  float get_threshold() const {
+    return m_threshold;
+  }
+
+  int detect(const float *frame); // returns the number of blobs, largest first
+
+  int count() const {
+    return m_count;
+  }
+  const mlx_Blob &blob(int index) const {
+    return m_blob[index];
+  }
+
+private:
+  uint16_t find(uint16_t label);
+  uint16_t join(uint16_t a, uint16_t b);
+  void update_background(const float *frame);
+};
+
+#endif // MLXBlobs_HH
@@ -0,0 +1,1002 @@
+/*
+ * Based on MLX90640 code by Melexis N.V.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MLXCalc.hh"
+
+static int check_adjacent(uint16_t pix1, uint16_t pix2);
+
+int mlx_extract_parameters(const uint16_t *eeData, mlx_Parameters *params, float *scratch) {
+  struct mlx_Parameters *mlx90640 = params;
+
+  // ExtractVDDParameters
+
+  int16_t kVdd;
+  int16_t vdd25;
+
+  kVdd = eeData[51];
+
+  kVdd = (eeData[51] & 0xFF00) >> 8;
+  if (kVdd > 127) {
+    kVdd = kVdd - 256;
+  }
+  kVdd = 32 * kVdd;
+  vdd25 = eeData[51] & 0x00FF;
+  vdd25 = ((vdd25 - 256) << 5) - 8192;
+
+  mlx90640->kVdd = kVdd;
+  mlx90640->vdd25 = vdd25;
+
+  // ExtractPTATParameters
+
+  float KvPTAT = (eeData[50] & 0xFC00) >> 10;
+
+  if (KvPTAT > 31) {
+    KvPTAT = KvPTAT - 64;
+  }
+  KvPTAT = KvPTAT / 4096;
+
+  float KtPTAT = eeData[50] & 0x03FF;
+
+  if (KtPTAT > 511) {
+    KtPTAT = KtPTAT - 1024;
+  }
+  KtPTAT = KtPTAT / 8;
+
+  int16_t vPTAT25 = eeData[49];
+
+  float alphaPTAT = (eeData[16] & 0xF000) / pow(2, (double) 14) + 8.0f;
+
+  mlx90640->KvPTAT = KvPTAT;
+  mlx90640->KtPTAT = KtPTAT;
+  mlx90640->vPTAT25 = vPTAT25;
+  mlx90640->alphaPTAT = alphaPTAT;
+
+  // ExtractGainParameters
+
+  int16_t gainEE = eeData[48];
+
+  if (gainEE > 32767) {
+    gainEE = gainEE -65536;
+  }
+  mlx90640->gainEE = gainEE;
+
+  // ExtractTgcParameters
+
+  float tgc = eeData[60] & 0x00FF;
+
+  if (tgc > 127) {
+    tgc = tgc - 256;
+  }
+  tgc = tgc / 32.0f;
+
+  mlx90640->tgc = tgc;
+
+  // ExtractResolutionParameters
+
+  uint8_t resolutionEE = (eeData[56] & 0x3000) >> 12;
+
+  mlx90640->resolutionEE = resolutionEE;
+
+  // ExtractKsTaParameters
+
+  float KsTa = (eeData[60] & 0xFF00) >> 8;
+
+  if (KsTa > 127) {
+    KsTa = KsTa -256;
+  }
+  KsTa = KsTa / 8192.0f;
+
+  mlx90640->KsTa = KsTa;
+
+  // ExtractKsToParameters
+
+  int8_t step = ((eeData[63] & 0x3000) >> 12) * 10;
+
+  mlx90640->ct[0] = -40;
+  mlx90640->ct[1] = 0;
+  mlx90640->ct[2] = (eeData[63] & 0x00F0) >> 4;
+  mlx90640->ct[3] = (eeData[63] & 0x0F00) >> 8;
+
+  mlx90640->ct[2] = mlx90640->ct[2] * step;
+  mlx90640->ct[3] = mlx90640->ct[2] + mlx90640->ct[3] * step;
+  mlx90640->ct[4] = 400;
+
+  int KsToScale = (eeData[63] & 0x000F) + 8;
+  KsToScale = 1 << KsToScale;
+
+  mlx90640->ksTo[0] = eeData[61] & 0x00FF;
+  mlx90640->ksTo[1] = (eeData[61] & 0xFF00) >> 8;
+  mlx90640->ksTo[2] = eeData[62] & 0x00FF;
+  mlx90640->ksTo[3] = (eeData[62] & 0xFF00) >> 8;
+
+  for (int i = 0; i < 4; i++) {
+    if (mlx90640->ksTo[i] > 127) {
+      mlx90640->ksTo[i] = mlx90640->ksTo[i] - 256;
+    }
+    mlx90640->ksTo[i] = mlx90640->ksTo[i] / KsToScale;
+  }
+  mlx90640->ksTo[4] = -0.0002;
+
+  // ExtractCPParameters
+
+  uint8_t alphaScale = ((eeData[32] & 0xF000) >> 12) + 27;
+
+  int16_t offsetSP[2];
+
+  offsetSP[0] = (eeData[58] & 0x03FF);
+  if (offsetSP[0] > 511) {
+    offsetSP[0] = offsetSP[0] - 1024;
+  }
+  offsetSP[1] = (eeData[58] & 0xFC00) >> 10;
+  if (offsetSP[1] > 31) {
+    offsetSP[1] = offsetSP[1] - 64;
+  }
+  offsetSP[1] = offsetSP[1] + offsetSP[0];
+
+  float alphaSP[2];
+
+  alphaSP[0] = (eeData[57] & 0x03FF);
+  if (alphaSP[0] > 511) {
+    alphaSP[0] = alphaSP[0] - 1024;
+  }
+  alphaSP[0] = alphaSP[0] / pow(2, (double) alphaScale);
+
+  alphaSP[1] = (eeData[57] & 0xFC00) >> 10;
+  if (alphaSP[1] > 31) {
+    alphaSP[1] = alphaSP[1] - 64;
+  }
+  alphaSP[1] = (1 + alphaSP[1]/128) * alphaSP[0];
+
+  mlx90640->cpAlpha[0] = alphaSP[0];
+  mlx90640->cpAlpha[1] = alphaSP[1];
+
+  float cpKta = (eeData[59] & 0x00FF);
+  if (cpKta > 127) {
+    cpKta = cpKta - 256;
+  }
+
+  uint8_t ktaScale1 = ((eeData[56] & 0x00F0) >> 4) + 8;
+  mlx90640->cpKta = cpKta / pow(2, (double) ktaScale1);
+
+  float cpKv = (eeData[59] & 0xFF00) >> 8;
+  if (cpKv > 127) {
+    cpKv = cpKv - 256;
+  }
+
+  uint8_t kvScale = (eeData[56] & 0x0F00) >> 8;
+  mlx90640->cpKv = cpKv / pow(2, (double) kvScale);
+
+  mlx90640->cpOffset[0] = offsetSP[0];
+  mlx90640->cpOffset[1] = offsetSP[1];
+
+  // ExtractAlphaParameters
+
+  int accRow[24];
+  int accColumn[32];
+
+  uint8_t accRemScale    =   eeData[32] & 0x000F;
+  uint8_t accColumnScale =  (eeData[32] & 0x00F0) >> 4;
+  uint8_t accRowScale    =  (eeData[32] & 0x0F00) >> 8;
+
+  alphaScale = ((eeData[32] & 0xF000) >> 12) + 30; // Note: was +27 earlier
+
+  int alphaRef = eeData[33];
+
+  for (int i = 0; i < 6; i++) {
+    int p = i * 4;
+    accRow[p + 0] = (eeData[34 + i] & 0x000F);
+    accRow[p + 1] = (eeData[34 + i] & 0x00F0) >> 4;
+    accRow[p + 2] = (eeData[34 + i] & 0x0F00) >> 8;
+    accRow[p + 3] = (eeData[34 + i] & 0xF000) >> 12;
+  }
+
+  for (int i = 0; i < 24; i++) {
+    if (accRow[i] > 7) {
+      accRow[i] = accRow[i] - 16;
+    }
+  }
+
+  for (int i = 0; i < 8; i++) {
+    int p = i * 4;
+    accColumn[p + 0] = (eeData[40 + i] & 0x000F);
+    accColumn[p + 1] = (eeData[40 + i] & 0x00F0) >> 4;
+    accColumn[p + 2] = (eeData[40 + i] & 0x0F00) >> 8;
+    accColumn[p + 3] = (eeData[40 + i] & 0xF000) >> 12;
+  }
+
+  for (int i = 0; i < 32; i ++) {
+    if (accColumn[i] > 7) {
+      accColumn[i] = accColumn[i] - 16;
+    }
+  }
+
+  float *scratchData = scratch;
+
+  for (int i = 0; i < 24; i++) {
+    for(int j = 0; j < 32; j ++) {
+      int p = 32 * i + j;
+      scratchData[p] = (eeData[64 + p] & 0x03F0) >> 4;
+      if (scratchData[p] > 31) {
+	scratchData[p] = scratchData[p] - 64;
+      }
+      scratchData[p] *= (1 << accRemScale);
+      scratchData[p] += alphaRef + (accRow[i] << accRowScale) + (accColumn[j] << accColumnScale);
+      scratchData[p] /= pow(2, (double) alphaScale);
+      scratchData[p] -= mlx90640->tgc * (mlx90640->cpAlpha[0] + mlx90640->cpAlpha[1]) / 2;
+      scratchData[p]  = mlx_SCALEALPHA / scratchData[p];
+    }
+  }
+
+  float temp = scratchData[0];
+  for (int i = 1; i < 768; i++) {
+    if (scratchData[i] > temp) {
+      temp = scratchData[i];
+    }
+  }
+
+  alphaScale = 0;
+  while (temp < 32768) {
+    temp *= 2;
+    alphaScale += 1;
+  }
+
+  for (int i = 0; i < 768; i++) {
+    temp = scratchData[i] * pow(2, (double) alphaScale);
+    mlx90640->alpha[i] = (temp + 0.5);
+  }
+  mlx90640->alphaScale = alphaScale;
+
+  // ExtractOffsetParameters
+
+  int *occRow    = accRow; // reuse space
+  int *occColumn = accColumn;
+
+  uint8_t occRemScale    = (eeData[16] & 0x000F);
+  uint8_t occColumnScale = (eeData[16] & 0x00F0) >> 4;
+  uint8_t occRowScale    = (eeData[16] & 0x0F00) >> 8;
+
+  int16_t offsetRef = eeData[17];
+  if (offsetRef > 32767) {
+    offsetRef = offsetRef - 65536;
+  }
+
+  for (int i = 0; i < 6; i++) {
+    int p = i * 4;
+    occRow[p + 0] = (eeData[18 + i] & 0x000F);
+    occRow[p + 1] = (eeData[18 + i] & 0x00F0) >> 4;
+    occRow[p + 2] = (eeData[18 + i] & 0x0F00) >> 8;
+    occRow[p + 3] = (eeData[18 + i] & 0xF000) >> 12;
+  }
+
+  for (int i = 0; i < 24; i++) {
+    if (occRow[i] > 7) {
+      occRow[i] = occRow[i] - 16;
+    }
+  }
+
+  for (int i = 0; i < 8; i++) {
+    int p = i * 4;
+    occColumn[p + 0] = (eeData[24 + i] & 0x000F);
+    occColumn[p + 1] = (eeData[24 + i] & 0x00F0) >> 4;
+    occColumn[p + 2] = (eeData[24 + i] & 0x0F00) >> 8;
+    occColumn[p + 3] = (eeData[24 + i] & 0xF000) >> 12;
+  }
+
+  for (int i = 0; i < 32; i ++) {
+    if (occColumn[i] > 7) {
+      occColumn[i] = occColumn[i] - 16;
+    }
+  }
+
+  for (int i = 0; i < 24; i++) {
+    for (int j = 0; j < 32; j ++) {
+      int p = 32 * i +j;
+      mlx90640->offset[p] = (eeData[64 + p] & 0xFC00) >> 10;
+      if (mlx90640->offset[p] > 31) {
+	mlx90640->offset[p] = mlx90640->offset[p] - 64;
+      }
+      mlx90640->offset[p] *= (1 << occRemScale);
+      mlx90640->offset[p] += offsetRef + (occRow[i] << occRowScale) + (occColumn[j] << occColumnScale);
+    }
+  }
+
+  // ExtractKtaPixelParameters
+
+  int8_t KtaRC[4];
+
+  int8_t KtaRoCo = (eeData[54] & 0xFF00) >> 8;
+  if (KtaRoCo > 127) {
+    KtaRoCo = KtaRoCo - 256;
+  }
+  KtaRC[0] = KtaRoCo;
+
+  int8_t KtaReCo = (eeData[54] & 0x00FF);
+  if (KtaReCo > 127) {
+    KtaReCo = KtaReCo - 256;
+  }
+  KtaRC[2] = KtaReCo;
+
+  int8_t KtaRoCe = (eeData[55] & 0xFF00) >> 8;
+  if (KtaRoCe > 127) {
+    KtaRoCe = KtaRoCe - 256;
+  }
+  KtaRC[1] = KtaRoCe;
+
+  int8_t KtaReCe = (eeData[55] & 0x00FF);
+  if (KtaReCe > 127) {
+    KtaReCe = KtaReCe - 256;
+  }
+  KtaRC[3] = KtaReCe;
+
+//uint8_t ktaScale1 = ((eeData[56] & 0x00F0) >> 4) + 8;
+  uint8_t ktaScale2 =  (eeData[56] & 0x000F);
+
+  for (int i = 0; i < 24; i++) {
+    for (int j = 0; j < 32; j ++) {
+      int p = 32 * i + j;
+      uint8_t split = 2 * (p/32 - (p/64)*2) + p%2;
+      scratchData[p] = (eeData[64 + p] & 0x000E) >> 1;
+      if (scratchData[p] > 3) {
+	scratchData[p] -= 8;
+      }
+      scratchData[p] *= (1 << ktaScale2);
+      scratchData[p] += KtaRC[split];
+      scratchData[p] /= pow(2, (double) ktaScale1);
+    }
+  }
+
+  temp = fabs(scratchData[0]);
+  for (int i = 1; i < 768; i++) {
+    if (fabs(scratchData[i]) > temp) {
+      temp = fabs(scratchData[i]);
+    }
+  }
+
+  ktaScale1 = 0;
+  while (temp < 64) {
+    temp *= 2;
+    ktaScale1 += 1;
+  }
+
+  for (int i = 0; i < 768; i++) {
+    temp = scratchData[i] * pow(2, (double) ktaScale1);
+    if (temp < 0) {
+      mlx90640->kta[i] = (temp - 0.5);
+    } else {
+      mlx90640->kta[i] = (temp + 0.5);
+    }
+  }
+  mlx90640->ktaScale = ktaScale1;
+
+  // ExtractKvPixelParameters
+
+  int8_t KvT[4];
+
+  int8_t KvRoCo = (eeData[52] & 0xF000) >> 12;
+  if (KvRoCo > 7) {
+    KvRoCo = KvRoCo - 16;
+  }
+  KvT[0] = KvRoCo;
+
+  int8_t KvReCo = (eeData[52] & 0x0F00) >> 8;
+  if (KvReCo > 7) {
+    KvReCo = KvReCo - 16;
+  }
+  KvT[2] = KvReCo;
+
+  int8_t KvRoCe = (eeData[52] & 0x00F0) >> 4;
+  if (KvRoCe > 7) {
+    KvRoCe = KvRoCe - 16;
+  }
+  KvT[1] = KvRoCe;
+
+  int8_t KvReCe = (eeData[52] & 0x000F);
+  if (KvReCe > 7) {
+    KvReCe = KvReCe - 16;
+  }
+  KvT[3] = KvReCe;
+
+//uint8_t kvScale = (eeData[56] & 0x0F00) >> 8;
+
+  for (int i = 0; i < 24; i++) {
+    for (int j = 0; j < 32; j++) {
+      int p = 32 * i + j;
+      uint8_t split = 2 * (p/32 - (p/64)*2) + p%2;
+      scratchData[p]  = KvT[split];
+      scratchData[p] /= pow(2, (double) kvScale);
+    }
+  }
+
+  temp = fabs(scratchData[0]);
+  for (int i = 1; i < 768; i++) {
+    if (fabs(scratchData[i]) > temp) {
+      temp = fabs(scratchData[i]);
+    }
+  }
+
+  kvScale = 0;
+  while (temp < 64) {
+    temp *= 2;
+    kvScale += 1;
+  }
+
+  for (int i = 0; i < 768; i++) {
+    temp = scratchData[i] * pow(2, (double) kvScale);
+    if (temp < 0) {
+      mlx90640->kv[i] = (temp - 0.5);
+    } else {
+      mlx90640->kv[i] = (temp + 0.5);
+    }
+  }
+  mlx90640->kvScale = kvScale;
+
+  // ExtractCILCParameters
+
+  float ilChessC[3];
+
+  uint8_t calibrationModeEE = (eeData[10] & 0x0800) >> 4;
+  mlx90640->calibrationModeEE = calibrationModeEE ^ 0x80;
+
+  ilChessC[0] = (eeData[53] & 0x003F);
+  if (ilChessC[0] > 31) {
+    ilChessC[0] = ilChessC[0] - 64;
+  }
+  ilChessC[0] = ilChessC[0] / 16.0f;
+
+  ilChessC[1] = (eeData[53] & 0x07C0) >> 6;
+  if (ilChessC[1] > 15) {
+    ilChessC[1] = ilChessC[1] - 32;
+  }
+  ilChessC[1] = ilChessC[1] / 2.0f;
+
+  ilChessC[2] = (eeData[53] & 0xF800) >> 11;
+  if (ilChessC[2] > 15) {
+    ilChessC[2] = ilChessC[2] - 32;
+  }
+  ilChessC[2] = ilChessC[2] / 8.0f;
+
+  mlx90640->ilChessC[0] = ilChessC[0];
+  mlx90640->ilChessC[1] = ilChessC[1];
+  mlx90640->ilChessC[2] = ilChessC[2];
+
+  // ExtractDeviatingPixels
+
+  int warn = 0;
+
+  for (int p = 0; p < 5; p++) {
+    mlx90640->brokenPixels[p] = 0xFFFF;
+    mlx90640->outlierPixels[p] = 0xFFFF;
+  }
+
+  uint16_t brokenPixCnt = 0;
+  uint16_t outlierPixCnt = 0;
+  uint16_t pixCnt = 0;
+
+  while (pixCnt < 768 && brokenPixCnt < 5 && outlierPixCnt < 5) {
+    if (eeData[pixCnt+64] == 0) {
+      mlx90640->brokenPixels[brokenPixCnt] = pixCnt;
+      brokenPixCnt = brokenPixCnt + 1;
+    } else if ((eeData[pixCnt+64] & 0x0001) != 0) {
+      mlx90640->outlierPixels[outlierPixCnt] = pixCnt;
+      outlierPixCnt = outlierPixCnt + 1;
+    }
+    pixCnt++;
+  }
+
+  if (brokenPixCnt > 4) {
+    warn = -3;
+  } else if (outlierPixCnt > 4) {
+    warn = -4;
+  } else if ((brokenPixCnt + outlierPixCnt) > 4) {
+    warn = -5;
+  } else {
+    for (pixCnt = 0; pixCnt < brokenPixCnt; pixCnt++) {
+      for(int i = pixCnt + 1; i < brokenPixCnt; i++) {
+	warn = check_adjacent(mlx90640->brokenPixels[pixCnt], mlx90640->brokenPixels[i]);
+	if (warn != 0) {
+	  return warn; // broken pixel has adjacent broken pixel
+	}
+      }
+    }
+
+    for (pixCnt = 0; pixCnt < outlierPixCnt; pixCnt++) {
+      for (int i = pixCnt + 1; i < outlierPixCnt; i++) {
+	warn = check_adjacent(mlx90640->outlierPixels[pixCnt], mlx90640->outlierPixels[i]);
+	if (warn != 0) {
+	  return warn; // outlier pixel has adjacent outlier pixel
+	}
+      }
+    }
+
+    for (pixCnt = 0; pixCnt < brokenPixCnt; pixCnt++) {
+      for (int i = 0; i < outlierPixCnt; i++) {
+	warn = check_adjacent(mlx90640->brokenPixels[pixCnt], mlx90640->outlierPixels[i]);
+	if (warn != 0) {
+	  return warn; // broken pixel has adjacent outlier pixel
+	}
+      }
+    }
+  }
+
+  return warn;
+}
+
+static int check_adjacent(uint16_t pix1, uint16_t pix2) {
+  int pixPosDif = pix1 - pix2;
+
+  if (pixPosDif > -34 && pixPosDif < -30) {
+    return -6;
+  }
+  if (pixPosDif > -2 && pixPosDif < 2) {
+    return -6;
+  }
+  if (pixPosDif > 30 && pixPosDif < 34) {
+    return -6;
+  }
+  return 0;
+}
+
+float mlx_get_Vdd(const mlx_Parameters *params, const uint16_t *raw, mlx_Resolution resolution) {
+  return mlx_aux_Vdd(params, raw + MLX90640_AUX_FIRST, resolution);
+}
+
+float mlx_calculate_ambient(const mlx_Parameters *params, const uint16_t *raw, float vdd) {
+  return mlx_aux_ambient(params, raw + MLX90640_AUX_FIRST, vdd);
+}
+
+float mlx_aux_Vdd(const mlx_Parameters *params, const uint16_t *aux, mlx_Resolution resolution) {
+  float vdd = aux[810 - MLX90640_AUX_FIRST];
+  if (vdd > 32767) {
+    vdd = vdd - 65536;
+  }
+
+  int resolutionRAM = resolution;
+
+  float resolutionCorrection = pow(2, (double) params->resolutionEE) / pow(2, (double) resolutionRAM);
+
+  vdd = (resolutionCorrection * vdd - params->vdd25) / params->kVdd + 3.3;
+
+  return vdd;
+}
+
+float mlx_aux_ambient(const mlx_Parameters *params, const uint16_t *aux, float vdd) {
+  float ptat = aux[800 - MLX90640_AUX_FIRST];
+  if (ptat > 32767) {
+    ptat = ptat - 65536;
+  }
+
+  float ptatArt = aux[768 - MLX90640_AUX_FIRST];
+  if (ptatArt > 32767) {
+    ptatArt = ptatArt - 65536;
+  }
+  ptatArt = (ptat / (ptat * params->alphaPTAT + ptatArt)) * pow(2, (double) 18);
+
+  float ta = (ptatArt / (1 + params->KvPTAT * (vdd - 3.3)) - params->vPTAT25);
+  ta = ta / params->KtPTAT + 25;
+
+  return ta;
+}
+
+/* Everything that is constant over a subpage.
+ */
+struct mlx_FrameConstants {
+  float ta;
+  float _ta;
+  float _vdd;
+  float taTr;
+  float gain;
+  float ktaScale;
+  float kvScale;
+  float alphaScale;
+  float alphaCorrR[4];
+  float irDataCP[2];
+  bool  bCalMatch; // acquisition mode == calibration mode
+};
+
+static const float s_emissivity = 0.95;
+
+static void mlx_frame_constants(const mlx_Parameters *params, const uint16_t *raw, mlx_Mode camMode, mlx_Resolution resolution,
+				mlx_FrameConstants &K) {
+  const float openair = 8; // For a MLX90640 in the open air the shift is -8 degC.
+  const float emissivity = s_emissivity;
+
+  float vdd = mlx_get_Vdd(params, raw, resolution);
+  float ta  = mlx_calculate_ambient(params, raw, vdd);
+  float tr  = ta - openair;
+
+  float _ta  = ta - 25;
+  float _vdd = vdd - 3.3;
+
+  float ta4 = (ta + 273.15);
+  ta4 = ta4 * ta4;
+  ta4 = ta4 * ta4;
+
+  float tr4 = (tr + 273.15);
+  tr4 = tr4 * tr4;
+  tr4 = tr4 * tr4;
+
+  K.ta   = ta;
+  K._ta  = _ta;
+  K._vdd = _vdd;
+  K.taTr = tr4 - (tr4 - ta4) / emissivity;
+
+  K.ktaScale   = pow(2, (double) params->ktaScale);
+  K.kvScale    = pow(2, (double) params->kvScale);
+  K.alphaScale = pow(2, (double) params->alphaScale);
+
+  K.alphaCorrR[0] = 1 / (1 + params->ksTo[0] * 40);
+  K.alphaCorrR[1] = 1 ;
+  K.alphaCorrR[2] = (1 + params->ksTo[1] * params->ct[2]);
+  K.alphaCorrR[3] = K.alphaCorrR[2] * (1 + params->ksTo[2] * (params->ct[3] - params->ct[2]));
+
+//------------------------- Gain calculation -----------------------------------
+  float gain = raw[778];
+  if (gain > 32767) {
+    gain = gain - 65536;
+  }
+  gain = params->gainEE / gain;
+
+  K.gain = gain;
+
+//------------------------- To calculation -------------------------------------
+  uint8_t mode = (camMode == MLX90640_CHESS) ? 0x80 : 0x00; // (raw[832] & 0x1000) >> 5;
+
+  K.bCalMatch = (mode == params->calibrationModeEE);
+
+  float *irDataCP = K.irDataCP;
+  irDataCP[0] = raw[776];
+  irDataCP[1] = raw[808];
+  for (int i = 0; i < 2; i++) {
+    if (irDataCP[i] > 32767) {
+      irDataCP[i] = irDataCP[i] - 65536;
+    }
+    irDataCP[i] = irDataCP[i] * gain;
+  }
+  irDataCP[0] -= params->cpOffset[0] * (1 + params->cpKta * _ta) * (1 + params->cpKv * _vdd);
+
+  if (K.bCalMatch) {
+    irDataCP[1] -= params->cpOffset[1] * (1 + params->cpKta * _ta) * (1 + params->cpKv * _vdd);
+  } else {
+    irDataCP[1] -= (params->cpOffset[1] + params->ilChessC[0]) * (1 + params->cpKta * _ta) * (1 + params->cpKv * _vdd);
+  }
+}
+
+float mlx_calculate_temperatures_generic(const mlx_Parameters *params, const uint16_t *raw, mlx_Mode camMode, mlx_Resolution resolution,
+					 uint16_t subpage, float *result) {
+  const float emissivity = s_emissivity;
+
+  mlx_FrameConstants K;
+  mlx_frame_constants(params, raw, camMode, resolution, K);
+
+  uint8_t mode = (camMode == MLX90640_CHESS) ? 0x80 : 0x00;
+
+  for (int pixelNumber = 0; pixelNumber < 768; pixelNumber++) {
+    int8_t ilPattern    = pixelNumber / 32 - (pixelNumber / 64) * 2;
+    int8_t chessPattern = ilPattern ^ (pixelNumber - (pixelNumber/2)*2);
+    int8_t conversionPattern = ((pixelNumber + 2) / 4 - (pixelNumber + 3) / 4 + (pixelNumber + 1) / 4 - pixelNumber / 4) * (1 - 2 * ilPattern);
+
+    int8_t pattern = (mode == 0) ? ilPattern : chessPattern;
+
+    if (pattern == subpage) {
+      float irData = raw[pixelNumber];
+      if (irData > 32767) {
+	irData = irData - 65536;
+      }
+      irData *= K.gain;
+
+      float kta = params->kta[pixelNumber] / K.ktaScale;
+      float kv  = params->kv[pixelNumber] / K.kvScale;
+
+      irData -= params->offset[pixelNumber] * (1 + kta*K._ta) * (1 + kv*K._vdd);
+
+      if (!K.bCalMatch) {
+	irData += params->ilChessC[2] * (2 * ilPattern - 1) - params->ilChessC[1] * conversionPattern;
+      }
+      irData -= params->tgc * K.irDataCP[subpage];
+      irData /= emissivity;
+
+      float alphaCompensated = mlx_SCALEALPHA * K.alphaScale / params->alpha[pixelNumber];
+      alphaCompensated *= (1 + params->KsTa * K._ta);
+
+      float Sx = alphaCompensated * alphaCompensated * alphaCompensated * (irData + alphaCompensated * K.taTr);
+      Sx = sqrt(sqrt(Sx)) * params->ksTo[1];
+
+      float To = sqrt(sqrt(irData/(alphaCompensated * (1 - params->ksTo[1] * 273.15) + Sx) + K.taTr)) - 273.15;
+
+      int8_t range = 3;
+
+      if (To < params->ct[1]) {
+	range = 0;
+      } else if (To < params->ct[2]) {
+	range = 1;
+      } else if (To < params->ct[3]) {
+	range = 2;
+      }
+
+      To = sqrt(sqrt(irData / (alphaCompensated * K.alphaCorrR[range] * (1 + params->ksTo[range] * (To - params->ct[range]))) + K.taTr)) - 273.15;
+
+      result[pixelNumber] = To;
+    }
+  }
+  return K.ta;
+}
+
+/* Pixel tables, generated at compile time: the 384 pixels of each (mode, subpage), each
+ * with the sign of its interleave pattern and its conversion pattern, for the ilChessC
+ * correction.
+ */
+struct mlx_PixelEntry {
+  uint16_t index;
+  int8_t   ilSign;     // 2 * ilPattern - 1
+  int8_t   conversion; // conversionPattern
+};
+
+struct mlx_PixelTable {
+  mlx_PixelEntry entry[384];
+};
+
+static constexpr mlx_PixelTable mlx_make_pixel_table(int mode, int subpage) {
+  mlx_PixelTable table {};
+  int n = 0;
+  for (int p = 0; p < 768; p++) {
+    int ilPattern    = p / 32 - (p / 64) * 2;
+    int chessPattern = ilPattern ^ (p - (p / 2) * 2);
+    int pattern = (mode == MLX90640_CHESS) ? chessPattern : ilPattern;
+    if (pattern == subpage) {
+      table.entry[n].index      = p;
+      table.entry[n].ilSign     = 2 * ilPattern - 1;
+      table.entry[n].conversion = ((p + 2) / 4 - (p + 3) / 4 + (p + 1) / 4 - p / 4) * (1 - 2 * ilPattern);
+      ++n;
+    }
+  }
+  return table;
+}
+
+template<int Mode, int Subpage>
+struct mlx_Pixels {
+  static constexpr mlx_PixelTable table = mlx_make_pixel_table(Mode, Subpage);
+};
+template<int Mode, int Subpage>
+constexpr mlx_PixelTable mlx_Pixels<Mode, Subpage>::table;
+
+/* One kernel per (mode, subpage, calibration-mode match): the pixel loop visits only the
+ * subpage's pixels, without pattern arithmetic or per-pixel mode tests. The arithmetic is
+ * that of mlx_calculate_temperatures_generic(), with the frame-constant parts hoisted out
+ * of the loop, and gives identical results.
+ */
+template<int Mode, int Subpage, bool bCalMatch>
+static void mlx_kernel(const mlx_Parameters *params, const uint16_t *raw, const mlx_FrameConstants &K, float *result) {
+  const mlx_PixelEntry *entry = mlx_Pixels<Mode, Subpage>::table.entry;
+
+  const float emissivity = s_emissivity;
+
+  const float  ktaRecip  = 1 / K.ktaScale; // powers of two, so multiplying is exact
+  const float  kvRecip   = 1 / K.kvScale;
+  const float  alphaNum  = mlx_SCALEALPHA * K.alphaScale;
+  const float  alphaTa   = 1 + params->KsTa * K._ta;
+  const float  irDataCP  = params->tgc * K.irDataCP[Subpage];
+  const float  ksTo1     = params->ksTo[1];
+  const double ksTo1K    = 1 - params->ksTo[1] * 273.15;
+  const float  ilChessC1 = params->ilChessC[1];
+  const float  ilChessC2 = params->ilChessC[2];
+
+  for (int n = 0; n < 384; n++) {
+    const int p = entry[n].index;
+
+    float irData = (int16_t) raw[p];
+    irData *= K.gain;
+
+    float kta = params->kta[p] * ktaRecip;
+    float kv  = params->kv[p] * kvRecip;
+
+    irData -= params->offset[p] * (1 + kta*K._ta) * (1 + kv*K._vdd);
+
+    if (!bCalMatch) {
+      irData += ilChessC2 * entry[n].ilSign - ilChessC1 * entry[n].conversion;
+    }
+    irData -= irDataCP;
+    irData /= emissivity;
+
+    float alphaCompensated = alphaNum / params->alpha[p];
+    alphaCompensated *= alphaTa;
+
+    float Sx = alphaCompensated * alphaCompensated * alphaCompensated * (irData + alphaCompensated * K.taTr);
+    Sx = sqrt(sqrt(Sx)) * ksTo1;
+
+    float To = sqrt(sqrt(irData/(alphaCompensated * ksTo1K + Sx) + K.taTr)) - 273.15;
+
+    int8_t range = 3;
+
+    if (To < params->ct[1]) {
+      range = 0;
+    } else if (To < params->ct[2]) {
+      range = 1;
+    } else if (To < params->ct[3]) {
+      range = 2;
+    }
+
+    To = sqrt(sqrt(irData / (alphaCompensated * K.alphaCorrR[range] * (1 + params->ksTo[range] * (To - params->ct[range]))) + K.taTr)) - 273.15;
+
+    result[p] = To;
+  }
+}
+
+typedef void (*mlx_KernelFn)(const mlx_Parameters *params, const uint16_t *raw, const mlx_FrameConstants &K, float *result);
+
+static const mlx_KernelFn s_kernels[2][2][2] = { // [mode][subpage][calibration mode matches]
+  { { mlx_kernel<MLX90640_CHESS,       0, false>, mlx_kernel<MLX90640_CHESS,       0, true> },
+    { mlx_kernel<MLX90640_CHESS,       1, false>, mlx_kernel<MLX90640_CHESS,       1, true> } },
+  { { mlx_kernel<MLX90640_INTERLEAVED, 0, false>, mlx_kernel<MLX90640_INTERLEAVED, 0, true> },
+    { mlx_kernel<MLX90640_INTERLEAVED, 1, false>, mlx_kernel<MLX90640_INTERLEAVED, 1, true> } }
+};
+
+float mlx_calculate_temperatures(const mlx_Parameters *params, const uint16_t *raw, mlx_Mode camMode, mlx_Resolution resolution,
+				 uint16_t subpage, float *result) {
+  if (subpage > 1) { // not something the MLX90640 reports
+    return mlx_calculate_temperatures_generic(params, raw, camMode, resolution, subpage, result);
+  }
+  mlx_FrameConstants K;
+  mlx_frame_constants(params, raw, camMode, resolution, K);
+
+  s_kernels[camMode == MLX90640_CHESS ? 0 : 1][subpage][K.bCalMatch ? 1 : 0](params, raw, K, result);
+
+  return K.ta;
+}
+
+/* Batch conversion. Subpages are taken mlx_BatchChunk at a time, so the frame constants fit
+ * on the stack, and within a chunk are grouped by kernel (mode, subpage and calibration-mode
+ * match). For each group, the 384 pixels are taken mlx_BatchBlock at a time: the block's
+ * calibration is converted to float once, including the parts of the arithmetic that don't
+ * depend on the frame, and then every subpage of the group is run over the block. The
+ * arithmetic is that of mlx_kernel(), operation for operation, and gives identical results.
+ */
+static const int mlx_BatchChunk = 16;
+static const int mlx_BatchBlock = 64;
+
+struct mlx_BatchConstants {
+  mlx_FrameConstants K;
+  float alphaTa;  // 1 + KsTa * (ta - 25)
+  float irDataCP; // tgc * the subpage's compensation pixel
+};
+
+template<int Mode, int Subpage, bool bCalMatch>
+static void mlx_batch_kernel(const mlx_Parameters *params, const mlx_BatchFrame *frames, const mlx_BatchConstants *C,
+			     const uint8_t *group, int count) {
+  const mlx_PixelEntry *entry = mlx_Pixels<Mode, Subpage>::table.entry;
+
+  const float emissivity = s_emissivity;
+
+  const float  ktaRecip  = 1 / C[group[0]].K.ktaScale; // the scales depend on the calibration alone
+  const float  kvRecip   = 1 / C[group[0]].K.kvScale;
+  const float  alphaNum  = mlx_SCALEALPHA * C[group[0]].K.alphaScale;
+  const float  ksTo1     = params->ksTo[1];
+  const double ksTo1K    = 1 - params->ksTo[1] * 273.15;
+  const float  ilChessC1 = params->ilChessC[1];
+  const float  ilChessC2 = params->ilChessC[2];
+
+  float offset[mlx_BatchBlock];
+  float kta[mlx_BatchBlock];
+  float kv[mlx_BatchBlock];
+  float alpha[mlx_BatchBlock];
+  float ilChess[mlx_BatchBlock];
+
+  for (int first = 0; first < 384; first += mlx_BatchBlock) {
+    for (int n = 0; n < mlx_BatchBlock; n++) {
+      const int p = entry[first + n].index;
+
+      offset[n] = params->offset[p];
+      kta[n]    = params->kta[p] * ktaRecip;
+      kv[n]     = params->kv[p] * kvRecip;
+      alpha[n]  = alphaNum / params->alpha[p];
+      if (!bCalMatch) {
+	ilChess[n] = ilChessC2 * entry[first + n].ilSign - ilChessC1 * entry[first + n].conversion;
+      }
+    }
+    for (int g = 0; g < count; g++) {
+      const uint16_t *raw = frames[group[g]].raw;
+      float *result = frames[group[g]].result;
+      const mlx_BatchConstants &B = C[group[g]];
+      const mlx_FrameConstants &K = B.K;
+
+      for (int n = 0; n < mlx_BatchBlock; n++) {
+	const int p = entry[first + n].index;
+
+	float irData = (int16_t) raw[p];
+	irData *= K.gain;
+
+	irData -= offset[n] * (1 + kta[n]*K._ta) * (1 + kv[n]*K._vdd);
+
+	if (!bCalMatch) {
+	  irData += ilChess[n];
+	}
+	irData -= B.irDataCP;
+	irData /= emissivity;
+
+	float alphaCompensated = alpha[n];
+	alphaCompensated *= B.alphaTa;
+
+	float Sx = alphaCompensated * alphaCompensated * alphaCompensated * (irData + alphaCompensated * K.taTr);
+	Sx = sqrt(sqrt(Sx)) * ksTo1;
+
+	float To = sqrt(sqrt(irData/(alphaCompensated * ksTo1K + Sx) + K.taTr)) - 273.15;
+
+	int8_t range = 3;
+
+	if (To < params->ct[1]) {
+	  range = 0;
+	} else if (To < params->ct[2]) {
+	  range = 1;
+	} else if (To < params->ct[3]) {
+	  range = 2;
+	}
+
+	To = sqrt(sqrt(irData / (alphaCompensated * K.alphaCorrR[range] * (1 + params->ksTo[range] * (To - params->ct[range]))) + K.taTr)) - 273.15;
+
+	result[p] = To;
+      }
+    }
+  }
+}
+
+typedef void (*mlx_BatchKernelFn)(const mlx_Parameters *params, const mlx_BatchFrame *frames, const mlx_BatchConstants *C,
+				  const uint8_t *group, int count);
+
+static const mlx_BatchKernelFn s_batch_kernels[8] = { // [mode][subpage][calibration mode matches], flattened
+  mlx_batch_kernel<MLX90640_CHESS,       0, false>, mlx_batch_kernel<MLX90640_CHESS,       0, true>,
+  mlx_batch_kernel<MLX90640_CHESS,       1, false>, mlx_batch_kernel<MLX90640_CHESS,       1, true>,
+  mlx_batch_kernel<MLX90640_INTERLEAVED, 0, false>, mlx_batch_kernel<MLX90640_INTERLEAVED, 0, true>,
+  mlx_batch_kernel<MLX90640_INTERLEAVED, 1, false>, mlx_batch_kernel<MLX90640_INTERLEAVED, 1, true>
+};
+
+void mlx_calculate_batch(const mlx_Parameters *params, mlx_BatchFrame *frames, size_t count) {
+  mlx_BatchConstants C[mlx_BatchChunk];
+  uint8_t kernel[mlx_BatchChunk];
+  uint8_t group[mlx_BatchChunk];
+
+  while (count) {
+    int chunk = (count < (size_t) mlx_BatchChunk) ? count : mlx_BatchChunk;
+
+    for (int f = 0; f < chunk; f++) { // the frame constants, up front
+      mlx_BatchFrame &F = frames[f];
+      if (F.subpage > 1) { // not something the MLX90640 reports
+	F.ta = mlx_calculate_temperatures_generic(params, F.raw, F.mode, F.resolution, F.subpage, F.result);
+	kernel[f] = 8;
+	continue;
+      }
+      mlx_FrameConstants &K = C[f].K;
+      mlx_frame_constants(params, F.raw, F.mode, F.resolution, K);
+
+      C[f].alphaTa  = 1 + params->KsTa * K._ta;
+      C[f].irDataCP = params->tgc * K.irDataCP[F.subpage];
+
+      kernel[f] = (F.mode == MLX90640_CHESS ? 0 : 4) + 2 * F.subpage + (K.bCalMatch ? 1 : 0);
+      F.ta = K.ta;
+    }
+    for (int k = 0; k < 8; k++) { // then the pixels, a kernel at a time
+      int members = 0;
+      for (int f = 0; f < chunk; f++) {
+	if (kernel[f] == k) {
+	  group[members++] = f;
+	}
+      }
+      if (members) {
+	s_batch_kernels[k](params, frames, C, group, members);
+      }
+    }
+    frames += chunk;
+    count  -= chunk;
+  }
+}
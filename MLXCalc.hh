@@ -0,0 +1,148 @@
+/*
+ * Based on MLX90640 code by Melexis N.V.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MLXCalc_HH
+#define MLXCalc_HH
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+/* The MLX90640 calibration and temperature calculation, free of any I2C or Arduino
+ * dependency so that the same code can run on the teensy and on a host.
+ */
+
+const float mlx_SCALEALPHA = 0.000001;
+
+enum mlx_Mode {
+  MLX90640_CHESS = 0,
+  MLX90640_INTERLEAVED
+};
+
+enum mlx_RefreshRate {
+  MLX90640_0_5_HZ = 0,
+  MLX90640_1_HZ,
+  MLX90640_2_HZ,
+  MLX90640_4_HZ,
+  MLX90640_8_HZ,
+  MLX90640_16_HZ,
+  MLX90640_32_HZ,
+  MLX90640_64_HZ
+};
+
+enum mlx_Resolution {
+  MLX90640_ADC_16BIT = 0,
+  MLX90640_ADC_17BIT,
+  MLX90640_ADC_18BIT,
+  MLX90640_ADC_19BIT
+};
+
+struct mlx_Parameters { // calibration, extracted from the EEPROM
+  int16_t  kVdd;
+  int16_t  vdd25;
+  float    KvPTAT;
+  float    KtPTAT;
+  uint16_t vPTAT25;
+  float    alphaPTAT;
+  int16_t  gainEE;
+  float    tgc;
+  float    cpKv;
+  float    cpKta;
+  uint8_t  resolutionEE;
+  uint8_t  calibrationModeEE;
+  float    KsTa;
+  float    ksTo[5];
+  int16_t  ct[5];
+  uint16_t alpha[768];
+  uint8_t  alphaScale;
+  int16_t  offset[768];
+  int8_t   kta[768];
+  uint8_t  ktaScale;
+  int8_t   kv[768];
+  uint8_t  kvScale;
+  float    cpAlpha[2];
+  int16_t  cpOffset[2];
+  float    ilChessC[3];
+  uint16_t brokenPixels[5];
+  uint16_t outlierPixels[5];
+};
+
+/* Extract the calibration from the 832-word EEPROM image; scratch must have room for 768
+ * floats. Returns 0, or non-zero if there are too many, or adjacent, bad pixels:
+ * -3 broken, -4 outlier, -5 broken+outlier, -6 adjacent.
+ */
+int mlx_extract_parameters(const uint16_t *eeData, mlx_Parameters *params, float *scratch);
+
+float mlx_get_Vdd(const mlx_Parameters *params, const uint16_t *raw, mlx_Resolution resolution);
+float mlx_calculate_ambient(const mlx_Parameters *params, const uint16_t *raw, float vdd);
+
+/* The auxiliary words of the RAM image, raw[768..831] (PTAT, Vdd, gain and the compensation
+ * pixels). Vdd and the ambient temperature depend on these alone, so they can be had from
+ * the 64 words without the pixels:
+ */
+const uint16_t MLX90640_AUX_FIRST = 768;
+const uint16_t MLX90640_AUX_WORDS = 64;
+
+float mlx_aux_Vdd(const mlx_Parameters *params, const uint16_t *aux, mlx_Resolution resolution);
+float mlx_aux_ambient(const mlx_Parameters *params, const uint16_t *aux, float vdd);
+
+/* Convert one subpage of raw RAM (832 words) to temperatures; only the 384 pixels of the
+ * subpage are written to result. Returns the ambient temperature.
+ */
+float mlx_calculate_temperatures(const mlx_Parameters *params, const uint16_t *raw, mlx_Mode mode, mlx_Resolution resolution,
+				 uint16_t subpage, float *result);
+
+/* As above, looping over all 768 pixels and testing each against the mode and subpage;
+ * kept as the baseline for the kernels that mlx_calculate_temperatures() dispatches to.
+ */
+float mlx_calculate_temperatures_generic(const mlx_Parameters *params, const uint16_t *raw, mlx_Mode mode, mlx_Resolution resolution,
+					 uint16_t subpage, float *result);
+
+/* Batch conversion: any number of subpages with the same calibration, e.g., a segment of a
+ * log or one tick of several cameras. The subpages are taken 16 at a time: the frame
+ * constants (Vdd, ambient temperature, gain and compensation pixels) of each subpage in the
+ * chunk are worked out first; then its pixels are converted a block at a time, each block's
+ * calibration being unpacked once and used for every subpage of the chunk in turn, so a
+ * batch of more than 16 unpacks it once per chunk. Results are identical to
+ * mlx_calculate_temperatures() on each.
+ */
+struct mlx_BatchFrame {
+  const uint16_t *raw;    // subpage of raw RAM (832 words)
+  float          *result; // 768; only the pixels of the subpage are written
+  mlx_Mode        mode;
+  mlx_Resolution  resolution;
+  uint16_t        subpage;
+  float           ta;     // set to the ambient temperature
+};
+
+void mlx_calculate_batch(const mlx_Parameters *params, mlx_BatchFrame *frames, size_t count);
+
+inline uint16_t mlx_pixel_subpage(int pixelNumber, mlx_Mode mode) { // which subpage a pixel belongs to
+  int ilPattern = (pixelNumber >> 5) & 1;
+  return (mode == MLX90640_CHESS) ? (ilPattern ^ (pixelNumber & 1)) : ilPattern;
+}
+
+inline mlx_Mode mlx_control_mode(uint16_t control) { // decode the control register
+  return (control & 0x1000) ? MLX90640_CHESS : MLX90640_INTERLEAVED;
+}
+inline mlx_RefreshRate mlx_control_refresh_rate(uint16_t control) {
+  return static_cast<mlx_RefreshRate>((control & 0x0380) >> 7);
+}
+inline mlx_Resolution mlx_control_resolution(uint16_t control) {
+  return static_cast<mlx_Resolution>((control & 0x0C00) >> 10);
+}
+
+#endif // MLXCalc_HH
@@ -0,0 +1,125 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MLXColor.hh"
+#include "MLXEncode.hh"
+
+struct mlx_ColorRange {
+  int16_t T_min;
+  uint8_t rgb_min[3];
+  int16_t T_max;
+  uint8_t rgb_max[3];
+};
+
+static const mlx_ColorRange s_color_ranges[] = { // as in test/colors.py; the first match wins
+  { 150, { 255, 255,   0 }, 216, { 255, 245, 158 } },
+  { 100, { 255,  77,   0 }, 150, { 255, 255,   0 } },
+  {  40, { 247, 221, 219 }, 100, { 255,   0,   0 } },
+  {  30, { 255, 179, 220 },  40, { 218, 112, 214 } },
+  {   5, {  46, 139,  87 },  30, { 228, 250, 228 } },
+  {   0, {   0,   0, 255 },   5, {  46, 139,  87 } },
+  { -40, { 218, 240, 255 },   0, { 102, 190, 249 } }
+};
+
+MLXColor::MLXColor() {
+  const int ranges = sizeof(s_color_ranges) / sizeof(s_color_ranges[0]);
+
+  for (int code = 0; code < 4096; code++) {
+    float T = code / 16.0f - 40; // exact
+    uint32_t rgb = 0;            // default to black
+
+    for (int r = 0; r < ranges; r++) {
+      const mlx_ColorRange &cr = s_color_ranges[r];
+      if (T >= cr.T_min && T <= cr.T_max) {
+	float f = (T - cr.T_min) / (cr.T_max - cr.T_min);
+	for (int c = 0; c < 3; c++) {
+	  int value = (int) (cr.rgb_min[c] + (cr.rgb_max[c] - cr.rgb_min[c]) * f + 0.5f);
+	  rgb = rgb << 8 | (uint32_t) value;
+	}
+	break;
+      }
+    }
+    m_lut[code] = rgb;
+  }
+}
+
+void MLXColor::encode(const float *frame, uint16_t *codes) {
+  for (int p = 0; p < 768; p++) {
+    codes[p] = mlx_encode_temperature(frame[p]);
+  }
+}
+
+template<mlx_ColorFormat Format>
+static inline void put_pixel(void *buffer, int index, uint32_t rgb) {
+  if (Format == MLX90640_RGB565) {
+    static_cast<uint16_t *>(buffer)[index] = ((rgb >> 8) & 0xF800) | ((rgb >> 5) & 0x07E0) | ((rgb >> 3) & 0x001F);
+  } else {
+    uint8_t *ptr = static_cast<uint8_t *>(buffer) + 3 * index;
+    ptr[0] = rgb >> 16;
+    ptr[1] = rgb >> 8;
+    ptr[2] = rgb;
+  }
+}
+
+/* Output pixel (X,Y) samples the input at (X/Scale, Y/Scale), i.e., input pixels line up with
+ * every Scale-th output pixel, and the last Scale-1 columns (rows) repeat the last input column
+ * (row). Weights are in 1/(Scale*Scale), rounded to nearest.
+ */
+template<int Scale, mlx_ColorFormat Format>
+static void render_scaled(const uint32_t *lut, const uint16_t *codes, void *buffer) {
+  const int width = 32 * Scale;
+  const int shift = (Scale == 4) ? 4 : ((Scale == 2) ? 2 : 0);
+
+  int index = 0;
+  for (int Y = 0; Y < 24 * Scale; Y++) {
+    const int y  = Y / Scale;
+    const int fy = Y % Scale;
+    const uint16_t *row0 = codes + 32 * y;
+    const uint16_t *row1 = (y < 23) ? (row0 + 32) : row0;
+
+    for (int X = 0; X < width; X++) {
+      const int x  = X / Scale;
+      const int fx = X % Scale;
+      const int x1 = (x < 31) ? (x + 1) : x;
+
+      uint32_t code;
+      if (Scale == 1) {
+	code = row0[x];
+      } else {
+	code = ((Scale - fx) * (Scale - fy) * row0[x] + fx * (Scale - fy) * row0[x1]
+		+ (Scale - fx) * fy * row1[x] + fx * fy * row1[x1] + (Scale * Scale) / 2) >> shift;
+      }
+      put_pixel<Format>(buffer, index++, lut[code & 0x0FFF]);
+    }
+  }
+}
+
+bool MLXColor::render(const uint16_t *codes, int scale, mlx_ColorFormat format, void *buffer) const {
+  if (format == MLX90640_RGB565) {
+    switch (scale) {
+    case 1: render_scaled<1, MLX90640_RGB565>(m_lut, codes, buffer); return true;
+    case 2: render_scaled<2, MLX90640_RGB565>(m_lut, codes, buffer); return true;
+    case 4: render_scaled<4, MLX90640_RGB565>(m_lut, codes, buffer); return true;
+    default: break;
+    }
+  } else {
+    switch (scale) {
+    case 1: render_scaled<1, MLX90640_RGB888>(m_lut, codes, buffer); return true;
+    case 2: render_scaled<2, MLX90640_RGB888>(m_lut, codes, buffer); return true;
+    case 4: render_scaled<4, MLX90640_RGB888>(m_lut, codes, buffer); return true;
+    default: break;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,56 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MLXColor_HH
+#define MLXColor_HH
+
+#include <stdint.h>
+
+enum mlx_ColorFormat {
+  MLX90640_RGB565 = 0, // uint16_t per pixel, native byte order
+  MLX90640_RGB888      // three bytes per pixel: R, G, B
+};
+
+/* Colour rendering of a frame, with the colour ranges of test/colors.py.
+ *
+ * The constructor fills a lookup table from the 12-bit temperature code (see MLXEncode.hh:
+ * 16 * (T + 40), i.e., 1/16 degC steps over [-40,216] degC) to colour. render() works on
+ * codes only: optional 2x or 4x bilinear upscaling is done on the codes in integer
+ * arithmetic, and every output pixel is one table lookup, so the cost per pixel is fixed
+ * and there is no floating-point work after encode().
+ */
+class MLXColor {
+private:
+  uint32_t m_lut[4096]; // 0x00RRGGBB
+
+public:
+  MLXColor();
+
+  ~MLXColor() {
+    // ...
+  }
+
+  uint32_t rgb(uint16_t code) const {
+    return m_lut[code & 0x0FFF];
+  }
+
+  static void encode(const float *frame, uint16_t *codes); // 768 temperatures to 768 codes
+
+  /* Writes (32 * scale) x (24 * scale) pixels, row by row, into buffer; scale is 1, 2 or 4.
+   * Returns false (and writes nothing) for any other scale.
+   */
+  bool render(const uint16_t *codes, int scale, mlx_ColorFormat format, void *buffer) const;
+};
+
+#endif // MLXColor_HH
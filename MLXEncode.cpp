@@ -0,0 +1,104 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MLXEncode.hh"
+
+const char mlx_Base64[65] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ=%";
+
+void mlx_encode_frame(const float *frame, char *buffer) {
+  char *ptr = buffer;
+
+  for (int row = 0; row < 24; row++) {
+    *ptr++ = '{';
+    *ptr++ = mlx_Base64[row];
+
+    for (int col = 0; col < 32; col++) {
+      uint16_t code = mlx_encode_temperature(*frame++);
+      *ptr++ = mlx_Base64[code >> 6];
+      *ptr++ = mlx_Base64[code & 0x3F];
+    }
+    *ptr++ = '}';
+    *ptr++ = ';';
+  }
+}
+
+MLXFramePool::MLXFramePool() :
+  m_latest(0),
+  m_sequence(0),
+  m_skipped(0)
+{
+  for (int f = 0; f < mlx_FramePoolSize; f++) {
+    m_frame[f].sequence = 0;
+    m_frame[f].refs = 0;
+    m_frame[f].bPacket = false;
+    m_frame[f].length = 0;
+  }
+}
+
+mlx_EncodedFrame *MLXFramePool::reserve() {
+  for (int f = 0; f < mlx_FramePoolSize; f++) {
+    if (!m_frame[f].refs) {
+      return m_frame + f;
+    }
+  }
+  ++m_skipped;
+  return 0;
+}
+
+void MLXFramePool::make_latest(mlx_EncodedFrame *slot) {
+  slot->sequence = ++m_sequence;
+  slot->refs = 1;
+
+  if (m_latest) {
+    release(m_latest);
+  }
+  m_latest = slot;
+}
+
+bool MLXFramePool::publish(const float *frame) {
+  mlx_EncodedFrame *slot = reserve();
+  if (!slot) {
+    return false;
+  }
+  mlx_encode_frame(frame, slot->text);
+  slot->bPacket = false;
+  slot->length = mlx_EncodedFrameLength;
+  make_latest(slot);
+  return true;
+}
+
+bool MLXFramePool::publish(const mlx_RecordFrame &frame) {
+  mlx_EncodedFrame *slot = reserve();
+  if (!slot) {
+    return false;
+  }
+  slot->bPacket = true;
+  slot->length = mlx_pack_subpage(frame, reinterpret_cast<uint8_t *>(slot->text));
+  make_latest(slot);
+  return true;
+}
+
+mlx_EncodedFrame *MLXFramePool::acquire(uint32_t sequence) {
+  if (!m_latest || m_latest->sequence == sequence) {
+    return 0;
+  }
+  ++m_latest->refs;
+  return m_latest;
+}
+
+void MLXFramePool::release(mlx_EncodedFrame *frame) {
+  if (frame && frame->refs) {
+    --frame->refs;
+  }
+}
@@ -0,0 +1,95 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MLXEncode_HH
+#define MLXEncode_HH
+
+#include <stdint.h>
+
+#include "MLXPacket.hh"
+
+/* Text encoding of a frame, as read by ircam.py: one line per row,
+ *
+ *   {R<64 characters>};
+ *
+ * where R is the row number (0-23) as a Base64 digit, and each pixel is a 12-bit value,
+ * 16 * (T + 40) clamped to [0,4095], i.e., a temperature in the range [-40,216] degC,
+ * written as two Base64 digits, most significant first. Line ends are not included.
+ */
+const int mlx_EncodedRowLength   = 68;                      // '{' + row + 64 + '}' + ';'
+const int mlx_EncodedFrameLength = 24 * mlx_EncodedRowLength;
+
+extern const char mlx_Base64[65];
+
+inline uint16_t mlx_encode_temperature(float t) { // 12-bit representation of temperature
+  int code = 16 * (t + 40);
+  if (code < 0) code = 0;
+  if (code > 4095) code = 4095;
+  return code;
+}
+
+/* Encodes the 768 temperatures of a frame into buffer, which must have room for
+ * mlx_EncodedFrameLength characters (no terminating zero is added).
+ */
+void mlx_encode_frame(const float *frame, char *buffer);
+
+/* A frame encoded once and shared, by reference count, between any number of outputs;
+ * or, in raw passthrough, a binary packet (MLXPacket.hh) in place of the text.
+ */
+const int mlx_SubpagePacketLength = mlx_PacketOverhead + mlx_SubpagePayload;
+const int mlx_EncodedBufferLength = (mlx_SubpagePacketLength > mlx_EncodedFrameLength) ? mlx_SubpagePacketLength : mlx_EncodedFrameLength;
+
+struct mlx_EncodedFrame {
+  uint32_t sequence; // 1, 2, ... in order of publication
+  uint8_t  refs;     // the pool's own reference to the latest, plus one per reader
+  bool     bPacket;  // text holds a packet of length bytes, rather than 24 encoded rows
+  uint16_t length;
+  char     text[mlx_EncodedBufferLength];
+};
+
+const int mlx_FramePoolSize = 4; // enough for the latest frame plus three outputs part-way through older ones
+
+/* Fixed pool of encoded frames. publish() encodes into a free slot and makes it the
+ * latest; an output calls acquire() when it is ready for a new frame, gets the latest (if
+ * newer than the one it last had) and sends it at its own pace, then calls release(). A
+ * slow output therefore skips frames rather than holding back the others. If every slot is
+ * in use, publish() gives up and the frame is lost for all outputs (counted by skipped()).
+ */
+class MLXFramePool {
+private:
+  mlx_EncodedFrame  m_frame[mlx_FramePoolSize];
+  mlx_EncodedFrame *m_latest;
+  uint32_t m_sequence;
+  unsigned long m_skipped;
+
+  mlx_EncodedFrame *reserve(); // a free slot, or 0 (counted as skipped)
+  void make_latest(mlx_EncodedFrame *slot);
+public:
+  MLXFramePool();
+
+  bool publish(const float *frame);
+  bool publish(const mlx_RecordFrame &frame); // raw subpage packet; the calibration, which no output may skip, doesn't go through the pool
+
+  mlx_EncodedFrame *acquire(uint32_t sequence); // latest frame if newer than sequence, else 0
+  void release(mlx_EncodedFrame *frame);
+
+  inline uint32_t latest_sequence() const {
+    return m_latest ? m_latest->sequence : 0;
+  }
+  inline unsigned long skipped() const {
+    return m_skipped;
+  }
+};
+
+#endif // MLXEncode_HH
@@ -0,0 +1,250 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "MLXPacket.hh"
+
+static uint8_t *mlx_put16(uint8_t *ptr, uint16_t value) {
+  *ptr++ = value & 0xFF;
+  *ptr++ = value >> 8;
+  return ptr;
+}
+
+static uint8_t *mlx_put32(uint8_t *ptr, uint32_t value) {
+  ptr = mlx_put16(ptr, value & 0xFFFF);
+  return mlx_put16(ptr, value >> 16);
+}
+
+static uint16_t mlx_get16(const uint8_t *ptr) {
+  return ptr[0] | (ptr[1] << 8);
+}
+
+static uint32_t mlx_get32(const uint8_t *ptr) {
+  return mlx_get16(ptr) | ((uint32_t) mlx_get16(ptr + 2) << 16);
+}
+
+static uint16_t mlx_fletcher16(const uint8_t *data, size_t length) {
+  uint16_t sum1 = 0;
+  uint16_t sum2 = 0;
+  while (length--) {
+    sum1 = (sum1 + *data++) % 255;
+    sum2 = (sum2 + sum1) % 255;
+  }
+  return (sum2 << 8) | sum1;
+}
+
+static uint8_t *mlx_begin_packet(uint8_t *buffer, mlx_PacketType type, uint16_t length) {
+  uint8_t *ptr = buffer;
+  *ptr++ = mlx_PacketSync[0];
+  *ptr++ = mlx_PacketSync[1];
+  *ptr++ = type;
+  return mlx_put16(ptr, length);
+}
+
+static size_t mlx_end_packet(uint8_t *buffer, uint8_t *ptr) {
+  ptr = mlx_put16(ptr, mlx_fletcher16(buffer + 2, ptr - buffer - 2));
+  return ptr - buffer;
+}
+
+size_t mlx_pack_calibration(const mlx_RecordHeader &header, uint8_t *buffer) {
+  uint8_t *ptr = mlx_begin_packet(buffer, MLX90640_PACKET_CALIBRATION, mlx_CalibrationPayload);
+
+  *ptr++ = header.address;
+  *ptr++ = 0;
+  for (int i = 0; i < 832; i++) {
+    ptr = mlx_put16(ptr, header.eeprom[i]);
+  }
+  return mlx_end_packet(buffer, ptr);
+}
+
+size_t mlx_pack_subpage(const mlx_RecordFrame &frame, uint8_t *buffer) {
+  uint8_t *ptr = mlx_begin_packet(buffer, MLX90640_PACKET_SUBPAGE, mlx_SubpagePayload);
+
+  ptr = mlx_put32(ptr, frame.timestamp);
+  ptr = mlx_put32(ptr, frame.sequence);
+  ptr = mlx_put16(ptr, frame.control);
+  *ptr++ = frame.subpage;
+  *ptr++ = frame.flags;
+
+  mlx_Mode mode = mlx_control_mode(frame.control);
+
+  for (int p = 0; p < 768; p++) {
+    if (mlx_pixel_subpage(p, mode) == frame.subpage) {
+      ptr = mlx_put16(ptr, frame.raw[p]);
+    }
+  }
+  for (int i = 0; i < MLX90640_AUX_WORDS; i++) {
+    ptr = mlx_put16(ptr, frame.raw[MLX90640_AUX_FIRST + i]);
+  }
+  return mlx_end_packet(buffer, ptr);
+}
+
+MLXPacketReader::MLXPacketReader() :
+  m_count(0),
+  m_length(0),
+  m_head(0),
+  m_tail(0),
+  m_packets(0),
+  m_errors(0),
+  m_skipped(0)
+{
+  // ...
+}
+
+mlx_PacketType MLXPacketReader::feed(uint8_t byte) {
+  if (m_tail == sizeof(m_queue)) { // bytes put back by rescan() are still waiting
+    memmove(m_queue, m_queue + m_head, m_tail - m_head);
+    m_tail -= m_head;
+    m_head = 0;
+  }
+  m_queue[m_tail++] = byte;
+
+  return drain();
+}
+
+mlx_PacketType MLXPacketReader::drain() {
+  while (m_head < m_tail) {
+    mlx_PacketType type = parse(m_queue[m_head++]);
+    if (type != MLX90640_PACKET_NONE) {
+      return type; // the rest, if any, waits for the next call
+    }
+  }
+  m_head = m_tail = 0;
+  return MLX90640_PACKET_NONE;
+}
+
+mlx_PacketType MLXPacketReader::flush() {
+  mlx_PacketType type;
+  while ((type = drain()) == MLX90640_PACKET_NONE && m_count) {
+    if (m_count > 1) {
+      ++m_errors; // cut short by the end of the stream
+    }
+    rescan();
+  }
+  return type;
+}
+
+void MLXPacketReader::rescan() {
+  /* The sync at the start of the buffer was false, or the packet was cut short by the next
+   * one; either way, the next sync may be among the bytes after it. Put them back ahead of
+   * anything still queued, to be parsed again.
+   */
+  uint16_t count  = m_count - 1;
+  uint16_t queued = m_tail - m_head;
+
+  memmove(m_queue + count, m_queue + m_head, queued);
+  memcpy(m_queue, m_buffer + 1, count);
+  m_head = 0;
+  m_tail = count + queued;
+
+  ++m_skipped; // the false sync
+  m_count = 0;
+}
+
+mlx_PacketType MLXPacketReader::parse(uint8_t byte) {
+  if (m_count == 0) { // looking for the sync
+    if (byte == mlx_PacketSync[0]) {
+      m_buffer[m_count++] = byte;
+    } else {
+      ++m_skipped;
+    }
+    return MLX90640_PACKET_NONE;
+  }
+  if (m_count == 1) {
+    if (byte == mlx_PacketSync[1]) {
+      m_buffer[m_count++] = byte;
+    } else {
+      ++m_skipped;          // the first sync byte was a false start
+      if (byte != mlx_PacketSync[0]) {
+	++m_skipped;
+	m_count = 0;
+      }
+    }
+    return MLX90640_PACKET_NONE;
+  }
+  m_buffer[m_count++] = byte;
+
+  if (m_count == 5) { // type and length
+    uint8_t type = m_buffer[2];
+    m_length = mlx_get16(m_buffer + 3);
+
+    if (!((type == MLX90640_PACKET_CALIBRATION && m_length == mlx_CalibrationPayload) ||
+	  (type == MLX90640_PACKET_SUBPAGE     && m_length == mlx_SubpagePayload))) {
+      ++m_errors;
+      rescan(); // not a packet after all
+    }
+    return MLX90640_PACKET_NONE;
+  }
+  if (m_count < mlx_PacketOverhead + m_length) {
+    return MLX90640_PACKET_NONE;
+  }
+  uint16_t checksum = mlx_get16(m_buffer + 5 + m_length); // complete; check it
+  if (checksum != mlx_fletcher16(m_buffer + 2, 3 + m_length)) {
+    ++m_errors;
+    rescan();
+    return MLX90640_PACKET_NONE;
+  }
+  m_count = 0;
+  ++m_packets;
+  return static_cast<mlx_PacketType>(m_buffer[2]);
+}
+
+bool MLXPacketReader::calibration(mlx_RecordHeader &header) const {
+  if (m_buffer[2] != MLX90640_PACKET_CALIBRATION || m_length != mlx_CalibrationPayload) {
+    return false;
+  }
+  const uint8_t *ptr = m_buffer + 5;
+
+  memcpy(header.magic, mlx_RecordMagic, 4);
+  header.version     = mlx_RecordVersion;
+  header.header_size = sizeof(mlx_RecordHeader);
+  header.frame_size  = sizeof(mlx_RecordFrame);
+  header.address     = ptr[0];
+  header.reserved    = 0;
+  header.start       = 0;
+
+  ptr += 2;
+  for (int i = 0; i < 832; i++, ptr += 2) {
+    header.eeprom[i] = mlx_get16(ptr);
+  }
+  return true;
+}
+
+bool MLXPacketReader::subpage(mlx_RecordFrame &frame) const {
+  if (m_buffer[2] != MLX90640_PACKET_SUBPAGE || m_length != mlx_SubpagePayload) {
+    return false;
+  }
+  const uint8_t *ptr = m_buffer + 5;
+
+  frame.timestamp = mlx_get32(ptr);
+  frame.sequence  = mlx_get32(ptr + 4);
+  frame.control   = mlx_get16(ptr + 8);
+  frame.subpage   = ptr[10] & 1;
+  frame.flags     = ptr[11];
+  ptr += 12;
+
+  mlx_Mode mode = mlx_control_mode(frame.control);
+
+  for (int p = 0; p < 768; p++) {
+    if (mlx_pixel_subpage(p, mode) == frame.subpage) {
+      frame.raw[p] = mlx_get16(ptr);
+      ptr += 2;
+    }
+  }
+  for (int i = 0; i < MLX90640_AUX_WORDS; i++, ptr += 2) {
+    frame.raw[MLX90640_AUX_FIRST + i] = mlx_get16(ptr);
+  }
+  return true;
+}
@@ -0,0 +1,110 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MLXPacket_HH
+#define MLXPacket_HH
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MLXCalc.hh"
+#include "MLXRecord.hh"
+
+/* Binary packets for raw passthrough, where the host rather than the teensy calculates the
+ * temperatures, with the same MLXCalc code and therefore the same results:
+ *
+ *   0xA5 0x5A <type> <length: 2> <payload: length bytes> <checksum: 2>
+ *
+ * All multi-byte values are little-endian; the checksum is Fletcher-16 over the type, the
+ * length and the payload. Payloads:
+ *
+ *   MLX90640_PACKET_CALIBRATION: address (1), reserved (1), EEPROM image (832 words)
+ *   MLX90640_PACKET_SUBPAGE:     timestamp (4), sequence (4), control (2), subpage (1),
+ *                                flags (1), the subpage's 384 pixels in pixel order, then
+ *                                the 64 aux words (RAM 768-831)
+ *
+ * As in the raw-frame logs (MLXRecord.hh), the calibration travels as the EEPROM image and
+ * is extracted on the host by mlx_extract_parameters(), which makes it independent of the
+ * layout of mlx_Parameters and a third of the size. The pixels of the other subpage are
+ * not sent, since the calculation doesn't read them; the mode is in the control word.
+ */
+const uint8_t mlx_PacketSync[2] = { 0xA5, 0x5A };
+
+enum mlx_PacketType {
+  MLX90640_PACKET_NONE = 0,
+  MLX90640_PACKET_CALIBRATION,
+  MLX90640_PACKET_SUBPAGE
+};
+
+const int mlx_PacketOverhead        = 7; // sync, type, length, checksum
+const int mlx_CalibrationPayload    = 2 + 2 * 832;
+const int mlx_SubpagePayload        = 12 + 2 * (384 + MLX90640_AUX_WORDS);
+const int mlx_PacketMaxLength       = mlx_PacketOverhead + mlx_CalibrationPayload;
+
+/* Pack into buffer, which must have room for mlx_PacketMaxLength bytes; return the length.
+ */
+size_t mlx_pack_calibration(const mlx_RecordHeader &header, uint8_t *buffer);
+size_t mlx_pack_subpage(const mlx_RecordFrame &frame, uint8_t *buffer);
+
+/* Byte-at-a-time packet parser. Anything between packets is skipped. A packet with a bad
+ * length or checksum is rejected from its first byte only: the bytes after that are parsed
+ * again, so a packet cut short by the next one (a byte lost on the serial link, say) costs
+ * just that packet, not the next one as well.
+ */
+class MLXPacketReader {
+private:
+  uint8_t  m_buffer[mlx_PacketMaxLength];
+  uint16_t m_count;  // bytes of the current packet so far
+  uint16_t m_length; // payload length, once known
+
+  uint8_t  m_queue[2 * mlx_PacketMaxLength]; // bytes to parse (again) before the next fed
+  uint16_t m_head;
+  uint16_t m_tail;
+
+  unsigned long m_packets;
+  unsigned long m_errors;  // bad length or checksum
+  unsigned long m_skipped; // bytes outside packets
+
+  void rescan();
+  mlx_PacketType parse(uint8_t byte);
+  mlx_PacketType drain();
+public:
+  MLXPacketReader();
+
+  mlx_PacketType feed(uint8_t byte); // the type of packet completed by this byte, if any
+
+  /* At the end of the stream: the packets still among the bytes to be parsed again, one per
+   * call, until MLX90640_PACKET_NONE. An incomplete packet is rejected like a bad one.
+   */
+  mlx_PacketType flush();
+
+  /* Unpack the packet just completed; false if it isn't of that type. Only the subpage's
+   * pixels and the aux words of frame.raw are written, so frame.raw can be kept from one
+   * subpage to the next, like MLX's RAM image.
+   */
+  bool calibration(mlx_RecordHeader &header) const;
+  bool subpage(mlx_RecordFrame &frame) const;
+
+  unsigned long packets() const {
+    return m_packets;
+  }
+  unsigned long errors() const {
+    return m_errors;
+  }
+  unsigned long skipped() const {
+    return m_skipped;
+  }
+};
+
+#endif // MLXPacket_HH
@@ -0,0 +1,52 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MLXRecord_HH
+#define MLXRecord_HH
+
+#include <stdint.h>
+
+/* Binary raw-frame log: one mlx_RecordHeader followed by any number of mlx_RecordFrame.
+ *
+ * Everything is little-endian, as on the teensy and on x86/ARM hosts, and neither struct
+ * has any padding, so records can be written as they are and the log memory-mapped on the
+ * host. The EEPROM image is stored once, so the calibration can be re-extracted later.
+ */
+const char     mlx_RecordMagic[4] = { 'M', 'L', 'X', 'R' };
+const uint16_t mlx_RecordVersion  = 1;
+
+struct mlx_RecordHeader {
+  char     magic[4];    // mlx_RecordMagic
+  uint16_t version;     // mlx_RecordVersion
+  uint16_t header_size; // sizeof(mlx_RecordHeader)
+  uint16_t frame_size;  // sizeof(mlx_RecordFrame)
+  uint8_t  address;     // I2C address of the sensor
+  uint8_t  reserved;
+  uint32_t start;       // micros() when the header was made
+  uint16_t eeprom[832]; // EEPROM image, 0x2400-0x273F
+};
+
+struct mlx_RecordFrame {
+  uint32_t timestamp; // micros() at data-ready
+  uint32_t sequence;  // subpage sequence number; gaps are missed subpages
+  uint16_t control;   // control register 0x800D
+  uint8_t  subpage;
+  uint8_t  flags;     // mlx_FrameFlags
+  uint16_t raw[832];  // RAM 0x0400-0x073F
+};
+
+static_assert(sizeof(mlx_RecordHeader) == 16 + 2 * 832, "mlx_RecordHeader must not be padded");
+static_assert(sizeof(mlx_RecordFrame)  == 12 + 2 * 832, "mlx_RecordFrame must not be padded");
+
+#endif // MLXRecord_HH
@@ -0,0 +1,157 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MLXTuner.hh"
+
+static const uint8_t s_holdoff_min =  2; // clean windows before the first attempt to step up
+static const uint8_t s_holdoff_max = 64;
+static const uint8_t s_settle       =  4; // subpages ignored after a change
+
+MLXTuner::MLXTuner(MLX &cam, mlx_TunePriority priority) :
+  m_cam(cam),
+  m_priority(priority),
+  m_rate_min(MLX90640_0_5_HZ),
+  m_rate_max(MLX90640_64_HZ),
+  m_res_min(MLX90640_ADC_16BIT),
+  m_res_max(MLX90640_ADC_19BIT),
+  m_rate_limit(MLX90640_64_HZ),
+  m_bLimitGood(false),
+  m_count(0),
+  m_late(0),
+  m_missed(0),
+  m_torn(0),
+  m_busy(0),
+  m_good(0),
+  m_holdoff(s_holdoff_min),
+  m_settle(0),
+  m_bStepped(false),
+  m_bEnabled(false)
+{
+  // ...
+}
+
+void MLXTuner::restart() {
+  m_good = 0;
+  m_holdoff = s_holdoff_min;
+  m_settle = 0;
+  m_bStepped = false;
+  m_rate_limit = m_rate_max;
+  m_bLimitGood = false;
+  begin_window();
+}
+
+void MLXTuner::begin_window() {
+  const mlx_FrameStats &stats = m_cam.get_stats();
+
+  m_count  = 0;
+  m_late   = 0;
+  m_missed = stats.missed;
+  m_torn   = stats.torn;
+  m_busy   = 0;
+}
+
+uint16_t MLXTuner::window_length() const { // about two seconds' worth of subpages, and at least four
+  uint16_t length = 1 << m_cam.cached_refresh_rate();
+  return (length < 4) ? 4 : length;
+}
+
+mlx_RefreshRate MLXTuner::rate_ceiling() const { // the fastest refresh rate to run at, given the priority
+  if (m_priority == MLX90640_TUNE_NOISE && m_bLimitGood && m_rate_limit > m_rate_min) {
+    return static_cast<mlx_RefreshRate>(m_rate_limit - 1);
+  }
+  return m_rate_limit;
+}
+
+bool MLXTuner::update() {
+  if (!m_bEnabled) return false;
+
+  if (m_settle) { // subpages straddling a change may be torn or late; don't count them
+    --m_settle;
+    begin_window();
+    return false;
+  }
+
+  const mlx_Timing &timing = m_cam.get_timing();
+
+  uint32_t busy = timing.read + timing.calc;
+  if (m_busy < busy) {
+    m_busy = busy;
+  }
+  if (++m_count < window_length()) {
+    return false;
+  }
+
+  const mlx_FrameStats &stats = m_cam.get_stats();
+
+  bool bBad = (stats.missed != m_missed) || (stats.torn != m_torn) || m_late || (m_busy * 10 > timing.period * 9);
+
+  bool bChanged = false;
+
+  if (bBad) {
+    if (m_bStepped) { // the last step up didn't work out; wait longer before trying again
+      m_holdoff = (m_holdoff < s_holdoff_max / 2) ? m_holdoff * 2 : s_holdoff_max;
+    } else {          // conditions have changed (e.g., more work elsewhere)
+      m_holdoff = s_holdoff_min;
+    }
+    m_good = 0;
+    m_bStepped = false;
+    bChanged = step_down();
+  } else {
+    m_bStepped = false;
+    if (m_cam.cached_refresh_rate() == m_rate_limit) {
+      m_bLimitGood = true;
+    }
+    if (m_cam.cached_refresh_rate() > rate_ceiling()) { // NOISE priority: stay below the fastest that works
+      m_cam.set_refresh_rate(rate_ceiling());
+      bChanged = true;
+    } else if (m_cam.cached_resolution() < m_res_max) { // a higher resolution costs nothing extra on the bus
+      m_cam.set_resolution(static_cast<mlx_Resolution>(m_cam.cached_resolution() + 1));
+      bChanged = true;
+    } else if (++m_good >= m_holdoff) {
+      /* A faster refresh rate halves the subpage period, so only try it with the time to spare.
+       */
+      if (m_busy * 5 <= timing.period * 2) {
+	bChanged = step_up();
+	m_bStepped = bChanged;
+      }
+      m_good = 0;
+    }
+  }
+  if (bChanged) {
+    m_settle = s_settle;
+  }
+  begin_window();
+
+  return bChanged;
+}
+
+bool MLXTuner::step_down() { // drops, late output or too little headroom: only a slower rate helps
+  mlx_RefreshRate rate = m_cam.cached_refresh_rate();
+
+  if (rate <= m_rate_min) return false;
+  if (m_rate_limit >= rate) {
+    m_rate_limit = static_cast<mlx_RefreshRate>(rate - 1);
+    m_bLimitGood = false;
+  }
+  m_cam.set_refresh_rate(static_cast<mlx_RefreshRate>(rate - 1));
+  return true;
+}
+
+bool MLXTuner::step_up() { // the next refresh rate, up to the ceiling
+  mlx_RefreshRate rate = m_cam.cached_refresh_rate();
+
+  if (rate >= rate_ceiling()) return false;
+  m_cam.set_refresh_rate(static_cast<mlx_RefreshRate>(rate + 1));
+  return true;
+}
@@ -0,0 +1,114 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MLXTuner_HH
+#define MLXTuner_HH
+
+#include "ClassMLX.hh"
+
+enum mlx_TunePriority {
+  MLX90640_TUNE_RATE = 0, // the fastest refresh rate that runs without drops
+  MLX90640_TUNE_NOISE     // one step slower than that, for less noise per frame
+};
+
+/* Closed-loop selection of refresh rate and ADC resolution.
+ *
+ * Call update() each time MLX::cycle() returns true. Over a window of about two seconds
+ * the tuner looks at dropped and torn subpages, late output (reported by the caller via
+ * output_late()) and the I2C + calculation time as a fraction of the subpage period. A bad
+ * window steps the refresh rate down at once, and the rate it failed at is not tried again
+ * until the tuner is restarted (enable(false), enable(true), e.g., after the load changes).
+ * The ADC resolution makes no difference to the I2C or calculation time, so it is never
+ * what needs to give, and it is stepped up to its limit whatever the priority. The refresh
+ * rate is stepped up, after a run of clean windows with headroom, to the fastest that hasn't
+ * failed; with NOISE priority it is then kept one step below that, once that rate has been
+ * seen to work. The first few subpages after any change are not counted.
+ */
+class MLXTuner {
+private:
+  MLX &m_cam;
+
+  mlx_TunePriority m_priority;
+
+  mlx_RefreshRate m_rate_min;
+  mlx_RefreshRate m_rate_max;
+  mlx_Resolution  m_res_min;
+  mlx_Resolution  m_res_max;
+
+  mlx_RefreshRate m_rate_limit; // the fastest refresh rate not yet seen to fail
+  bool            m_bLimitGood; // ... and it has been seen to work
+
+  uint16_t m_count;   // subpages so far in this window
+  uint16_t m_late;    // late output reports in this window
+  uint32_t m_missed;  // MLX stats at the start of the window
+  uint32_t m_torn;
+  uint32_t m_busy;    // worst read + calc time in this window
+
+  uint8_t m_good;     // consecutive clean windows
+  uint8_t m_holdoff;  // clean windows required before stepping up
+  uint8_t m_settle;   // subpages still to ignore after a change
+  bool    m_bStepped; // the last change was a step up
+
+  bool m_bEnabled;
+
+public:
+  MLXTuner(MLX &cam, mlx_TunePriority priority = MLX90640_TUNE_RATE);
+
+  ~MLXTuner() {
+    // ...
+  }
+
+  void enable(bool enabled) {
+    if (enabled && !m_bEnabled) {
+      restart();
+    }
+    m_bEnabled = enabled;
+  }
+  bool enabled() const {
+    return m_bEnabled;
+  }
+
+  void set_priority(mlx_TunePriority priority) {
+    m_priority = priority;
+  }
+  mlx_TunePriority get_priority() const {
+    return m_priority;
+  }
+
+  void set_limits(mlx_RefreshRate rate_min, mlx_RefreshRate rate_max, mlx_Resolution res_min, mlx_Resolution res_max) {
+    m_rate_min = rate_min;
+    m_rate_max = rate_max;
+    m_res_min  = res_min;
+    m_res_max  = res_max;
+    m_rate_limit = rate_max;
+    m_bLimitGood = false;
+  }
+
+  void output_late() { // the caller was still busy with the previous frame when this one arrived
+    ++m_late;
+  }
+
+  bool update(); // returns true if the refresh rate or resolution was changed
+
+private:
+  void restart();
+  void begin_window();
+  uint16_t window_length() const;
+  mlx_RefreshRate rate_ceiling() const;
+
+  bool step_down();
+  bool step_up();
+};
+
+#endif // MLXTuner_HH
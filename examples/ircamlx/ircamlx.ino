@@ -11,6 +11,10 @@
 
 #include <Shell.hh>
 #include <ClassMLX.hh>
+#include <MLXTuner.hh>
+#include <MLXEncode.hh>
+#include <MLXAlarm.hh>
+#include <MLXBlobs.hh>
 
 using namespace MultiShell;
 
@@ -20,6 +24,7 @@ using namespace MultiShell;
 #define Central_BufferLength 128 // print buffer length
 
 ShellStream serial_zero(Serial);
+ShellStream serial_one(Serial1); // hardware UART; frames go out on both
 
 Command sc_hello ("hello",      "hello",                        "Say hi :-)");
 Command sc_irmode("mode",       "mode [Chess|Interleaved]",     "IRCam acquisition mode");
@@ -27,19 +32,41 @@ Command sc_irrate("rate",       "rate [0.5|1|2|4|8|16|32|64]",  "IRCam frame rat
 Command sc_irres ("resolution", "resolution [16-19]",           "IRCam bit resolution");
 Command sc_sshot ("snapshot",   "snapshot [ambient|ascii|b64]", "IRCam: take a snapshot [default: ambient]");
 Command sc_ssauto("auto",       "auto [on|off]",                "Take snapshots automatically.");
+Command sc_stats ("stats",      "stats [reset]",                "IRCam: clean/torn/dropped subpages, skipped output frames");
+Command sc_tune  ("tune",       "tune [off|rate|noise]",        "IRCam: auto-tune rate & resolution, favouring rate or low noise");
+Command sc_alarm ("alarm",      "alarm [on|off|list]",          "IRCam: report threshold alarm events");
+Command sc_step  ("step",       "step [on|off|trigger]",        "IRCam: single-shot capture on trigger, instead of continuous");
+Command sc_blobs ("blobs",      "blobs [on|off|threshold|background]", "IRCam: report hot blobs [default: once]");
+Command sc_raw   ("raw",        "raw [on|off|calibration]",     "IRCam: send raw subpages as binary packets, for the host to convert");
 
 class Task_IRCam : public Task {
 private:
-  const float* m_ir;
-  const float* m_ptr;
+  MLXFramePool& m_pool;
+  mlx_EncodedFrame* m_frame; // the frame being sent, or 0 if finished
+  const char* m_ptr;  // next character to send
   int m_row;
-  int m_col;
+  int m_col;          // characters of the row sent so far; mlx_EncodedRowLength => line-break next
+                      // (or, for a packet, bytes of the packet sent so far)
+  uint32_t m_sequence;       // the last frame started
+  unsigned long m_skipped;   // frames published but never started on this stream
+  bool m_bLatest;            // drop policy: at the end of a row, abandon the frame if a newer one is ready
+
+  const uint8_t* m_calibration; // raw passthrough: calibration packet to send before the next packet, or 0
+  int m_calibration_length;
+  int m_calibration_sent;       // bytes of it sent so far
 public:
-  Task_IRCam(const float* ir) :
-    m_ir(ir),
+  Task_IRCam(MLXFramePool& pool) :
+    m_pool(pool),
+    m_frame(0),
     m_ptr(0),
     m_row(0),
-    m_col(0)
+    m_col(0),
+    m_sequence(0),
+    m_skipped(0),
+    m_bLatest(false),
+    m_calibration(0),
+    m_calibration_length(0),
+    m_calibration_sent(0)
   {
     // ...
   }
@@ -47,45 +74,101 @@ public:
     // ...
   }
 
-  inline void reset() {
-    m_ptr = m_ir;
+  inline void set_latest(bool bLatest) {
+    m_bLatest = bLatest;
+  }
+  inline unsigned long skipped() const {
+    return m_skipped;
+  }
+  inline bool pending() const { // whether a newer frame has been published
+    return m_pool.latest_sequence() != m_sequence;
+  }
+  inline bool calibration_pending() const {
+    return m_calibration;
+  }
+
+  /* Unlike frames, which may be skipped for a newer one, the calibration is sent to every
+   * stream in full, ahead of its next subpage packet. packet must stay valid until it's sent.
+   */
+  void send_calibration(const uint8_t* packet, int length) {
+    if (!m_calibration) { // if part-sent already, carry on: it's the same packet
+      m_calibration_sent = 0;
+    }
+    m_calibration = packet;
+    m_calibration_length = length;
+  }
+
+  bool reset() { // take the latest frame from the pool; returns false if there isn't a new one
+    mlx_EncodedFrame* frame = m_pool.acquire(m_sequence);
+    if (!frame) {
+      return false;
+    }
+    m_pool.release(m_frame);
+
+    if (m_sequence) {
+      m_skipped += frame->sequence - m_sequence - 1;
+    }
+    m_sequence = frame->sequence;
+    m_frame = frame;
+    m_ptr = frame->text;
     m_row = 0;
-    m_col = -1;
+    m_col = 0;
+    return true;
   }
 
   virtual bool process_task(ShellStream& stream, int& afw) { // returns true on completion of task
-    static const char* Base64 = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ=%";
-
-    while (afw > 2) { // check we can write at least two characters [or, weird glitch, *more* than 2 - FIXME?]
-      if (m_col < 0) { // start of row
-	stream.write('{', afw);
-	stream.write(Base64[m_row], afw); // add a row indicator
-	m_col = 0;
-      } else if (m_col == 32) { // end of row
-	stream.write('}', afw);
-	stream.write(';', afw);
-	++m_col;
-      } else if (m_col == 33) { // add a line-break, and progress
+    if (m_calibration && (!m_frame || (m_frame->bPacket && m_col == 0))) { // never part-way into a packet
+      int count = m_calibration_length - m_calibration_sent;
+      if (count > afw - 2) count = afw - 2;
+      if (count <= 0) return false;
+
+      const uint8_t* ptr = m_calibration + m_calibration_sent;
+      m_calibration_sent += count;
+      while (count--) {
+	stream.write(*ptr++, afw);
+      }
+      if (m_calibration_sent < m_calibration_length) {
+	return false;
+      }
+      m_calibration = 0;
+    }
+    if (m_frame && m_frame->bPacket) { // binary packet: no line-breaks, and never abandoned part-way
+      int count = m_frame->length - m_col;
+      if (count > afw - 2) count = afw - 2; // keep the same margin as for text, below
+      if (count <= 0) return false;
+
+      m_col += count;
+      while (count--) {
+	stream.write(*m_ptr++, afw);
+      }
+      if (m_col == m_frame->length) {
+	m_pool.release(m_frame);
+	m_frame = 0;
+      }
+      return !m_frame;
+    }
+    while (m_frame && afw > 2) { // leave at least two characters free [weird glitch, otherwise - FIXME?]
+      if (m_col == mlx_EncodedRowLength) { // end of row: add a line-break, and progress
 	stream.write_eol(afw);
-	if (m_row == 23) {
-	  m_ptr = 0;
+	if (++m_row == 24) {
+	  m_pool.release(m_frame);
+	  m_frame = 0;
 	  break;
-	}      
-	++m_row; // start the next row
-	m_col = -1;
-	break;   // voluntary pause - does this make a difference?
-      } else {
-	unsigned int index = m_row;
-	index = index << 5 | m_col;
-	int t = 16 * (m_ir[index] + 40); // 12-bit representation of temperature in range [-40,216] degC
-	if (t < 0) t = 0;
-	if (t > 4095) t = 4095;
-	stream.write(Base64[t >> 6], afw);
-	stream.write(Base64[t & 0x3F], afw);
-	++m_col;
+	}
+	m_col = 0;
+	if (m_bLatest && pending() && reset() && m_frame->bPacket) {
+	  return process_task(stream, afw); // the newer frame is a packet: send it as one
+	}
+      }
+      int count = mlx_EncodedRowLength - m_col;
+      if (count > afw - 2) count = afw - 2;
+
+      m_col += count;
+      while (count--) {
+	stream.write(*m_ptr++, afw);
       }
     }
-    return !m_ptr;
+    return !m_frame;
   }
 };
 
@@ -93,12 +176,24 @@ class IRCam : public Timer, public ShellHandler, public ShellStream::Responder {
 private:
   CommandList m_list;
   Shell  m_zero;
+  Shell  m_one;
   Shell *m_last;
 
   MLX m_cam;
+  MLXTuner m_tuner;
 
-  Task_IRCam m_task_ir;
-  TaskOwner<Task_IRCam> m_owner_ir;
+  MLXFramePool m_pool; // each frame is encoded once, then sent to every stream
+
+  MLXAlarms m_alarms;
+  mlx_AlarmEvent m_events[mlx_AlarmRules];
+
+  MLXBlobs m_blobs;
+  uint32_t m_blob_time; // us taken by the last detection
+
+  Task_IRCam m_task_zero;
+  Task_IRCam m_task_one;
+  TaskOwner<Task_IRCam> m_owner_zero;
+  TaskOwner<Task_IRCam> m_owner_one;
 
   char m_buffer[Central_BufferLength]; // temporary print buffer
   ShellBuffer m_B;
@@ -106,18 +201,32 @@ private:
   char m_ascii[24][33]; // matrix of characters for ASCII representation
 
   bool m_bAuto;
-  bool m_bAutoPrint;
+  bool m_bAlarms;
+  bool m_bBlobs;
+  bool m_bTriggered; // step mode: send the frame once it's ready
+
+  mlx_RecordHeader m_header; // raw passthrough: the calibration packet's contents
+  uint8_t m_calibration[mlx_PacketMaxLength]; // ... packed once, and sent from here to every stream
+  int m_calibration_length;
+  mlx_RecordFrame  m_record; // ... and each subpage's
 
 public:
   IRCam() :
     m_list(this),
     m_zero(serial_zero, m_list, 'u'),
+    m_one(serial_one, m_list, 'v'),
     m_last(0),
     m_cam(Master), // teensy 4, i2c channel 0
-    m_task_ir(m_cam.get_frame()),
+    m_tuner(m_cam),
+    m_blob_time(0),
+    m_task_zero(m_pool),
+    m_task_one(m_pool),
     m_B(m_buffer, Central_BufferLength),
     m_bAuto(false),
-    m_bAutoPrint(false)
+    m_bAlarms(false),
+    m_bBlobs(false),
+    m_bTriggered(false),
+    m_calibration_length(0)
   {
     m_list.add(sc_hello);     // The handler for the list is set in the constructor above
     m_list.add(sc_irmode);
@@ -125,8 +234,15 @@ public:
     m_list.add(sc_irres);
     m_list.add(sc_sshot);
     m_list.add(sc_ssauto);
+    m_list.add(sc_stats);
+    m_list.add(sc_tune);
+    m_list.add(sc_alarm);
+    m_list.add(sc_blobs);
+    m_list.add(sc_step);
+    m_list.add(sc_raw);
 
     m_zero.set_handler(this); // Need to set shell handler for CommaComms
+    m_one.set_handler(this);
     for (int row = 0; row < 24; row++) {
       m_ascii[row][32] = 0;   // zero-terminate each row of the matrix
     }
@@ -139,12 +255,71 @@ public:
 
     m_cam.cycle_mode(true);
 
-    m_owner_ir.push(m_task_ir, true); // give ownership of the ir task to the ir owner
+    mlx_AlarmRule hot  = { 1, MLX90640_ALARM_ABOVE, 0, 31, 0, 23, 4, 40, 2, 1000 }; // 4 pixels over 40 degC for 1 s
+    mlx_AlarmRule cold = { 2, MLX90640_ALARM_BELOW, 8, 23, 6, 17, 8,  5, 1, 5000 }; // centre: 8 pixels under 5 degC for 5 s
+    m_alarms.add(hot);
+    m_alarms.add(cold);
+
+    m_task_one.set_latest(true);         // the UART is the slower link: keep it on the latest frame
+
+    m_owner_zero.push(m_task_zero, true); // give ownership of the ir tasks to the ir owners
+    m_owner_one.push(m_task_one, true);
   }
   virtual ~IRCam() {
     // ...
   }
 
+  void detect_blobs() {
+    elapsedMicros timer;
+    m_blobs.detect(m_cam.get_frame());
+    m_blob_time = timer;
+  }
+
+  void send_blobs(Shell& shell) { // {#count,us}; then {#index,area,col,row,col_min,row_min,col_max,row_max,peak}; per blob
+    m_B.clear();
+    m_B.printf("{#%d,%lu};", m_blobs.count(), (unsigned long) m_blob_time);
+    shell << m_B << 0;
+
+    for (int b = 0; b < m_blobs.count(); b++) {
+      const mlx_Blob &blob = m_blobs.blob(b);
+      m_B.clear();
+      m_B.printf("{#%d,%u,%.1f,%.1f,%u,%u,%u,%u,%.1f};", b, (unsigned) blob.area, blob.col, blob.row,
+		 (unsigned) blob.col_min, (unsigned) blob.row_min, (unsigned) blob.col_max, (unsigned) blob.row_max, blob.peak);
+      shell << m_B << 0;
+    }
+  }
+
+  void send_event(const mlx_AlarmEvent& event) { // {!id,+/-,peak,row,col,ms}; - not a frame row, so ircam.py ignores it
+    m_B.clear();
+    m_B.printf("{!%u,%c,%.1f,%u,%u,%lu};", (unsigned) event.id, event.bActive ? '+' : '-', event.peak,
+	       (unsigned) event.row, (unsigned) event.col, (unsigned long) (event.timestamp / 1000));
+    m_zero << m_B << 0;
+    m_one  << m_B << 0;
+  }
+
+  void publish_calibration() { // raw passthrough: (re)send the EEPROM image, so a host can join at any time
+    m_cam.record_header(m_header);
+    m_calibration_length = mlx_pack_calibration(m_header, m_calibration);
+
+    m_task_zero.send_calibration(m_calibration, m_calibration_length);
+    m_task_one.send_calibration(m_calibration, m_calibration_length);
+  }
+
+  void publish_subpage() {
+    m_cam.record_frame(m_record);
+    m_pool.publish(m_record);
+  }
+
+  void send_frame(Shell& shell, Task_IRCam& task, TaskOwner<Task_IRCam>& owner) { // start the latest frame, if the stream is free
+    if (task.pending() || task.calibration_pending()) {
+      Task_IRCam *ir = owner.pop();
+      if (ir) {
+	ir->reset();
+	shell << *ir;
+      }
+    }
+  }
+
   virtual void stream_notification(ShellStream& stream, const char *message) {
 #ifdef ENABLE_FEEDBACK
     if (Serial) {
@@ -180,6 +355,18 @@ public:
     case 'a':
       m_bAuto = value;
       break;
+    case 'b': // blob threshold (or height above the background), in tenths of a degree
+      if (m_blobs.get_rule() == MLX90640_BLOB_THRESHOLD) {
+	m_blobs.set_threshold(value / 10.0f);
+      } else {
+	m_blobs.set_background(value / 10.0f);
+      }
+      break;
+    case 't': // threshold of the first (hot) alarm rule, in tenths of a degree
+      if (m_alarms.count()) {
+	m_alarms.set_threshold(m_alarms.rule(0).id, value / 10.0f);
+      }
+      break;
     default:
       break;
     }
@@ -187,15 +374,41 @@ public:
 
   virtual void every_milli() { // runs once a millisecond, on average
     if (m_cam.cycle()) {
-      m_bAutoPrint = m_bAuto;  // finished a collection sequence, report it (if on auto)
-    }
-    if (m_bAutoPrint) {
-      Task_IRCam *ir = m_owner_ir.pop();
-      if (ir) {
-	ir->reset();
-	m_zero << *ir;
-	m_bAutoPrint = false;
+      bool bStep = m_cam.get_step_mode();
+      if (m_cam.get_passthrough_mode()) { // every subpage goes out raw; the host calculates the frame
+	if (m_bAuto || (bStep && m_bTriggered)) {
+	  publish_subpage();
+	}
+	if (bStep && m_bTriggered && m_cam.frame_ready()) {
+	  m_bTriggered = false;
+	}
+      } else {
+	if (bStep && m_bTriggered && m_cam.frame_ready()) { // the triggered frame is complete
+	  m_bTriggered = false;
+	  m_pool.publish(m_cam.get_frame());
+	} else if (m_bAuto && !bStep) { // finished a collection sequence, report it (if on auto)
+	  if (m_task_zero.pending()) { // USB still hasn't started on the last one
+	    m_tuner.output_late();
+	  }
+	  m_pool.publish(m_cam.get_frame());
+	}
+	if (m_bBlobs) {
+	  detect_blobs();
+	  send_blobs(m_zero);
+	  send_blobs(m_one);
+	}
+	if (m_bAlarms) {
+	  int count = m_alarms.evaluate(m_cam.get_frame(), m_cam.get_timestamp(), m_events);
+	  for (int e = 0; e < count; e++) {
+	    send_event(m_events[e]);
+	  }
+	}
       }
+      m_tuner.update();
+    }
+    if (m_bAuto || m_cam.get_step_mode()) {
+      send_frame(m_zero, m_task_zero, m_owner_zero);
+      send_frame(m_one,  m_task_one,  m_owner_one);
     }
   }
 
@@ -208,11 +421,14 @@ public:
   }
 
   virtual void every_second() { // runs once every second
-    // ...
+    if (m_cam.get_passthrough_mode() && m_bAuto) {
+      publish_calibration();
+    }
   }
 
   virtual void tick() {
     m_zero.update();
+    m_one.update();
   }
 
   virtual CommandError shell_command(Shell& origin, Args& args) {
@@ -302,10 +518,11 @@ public:
     else if (args == "snapshot") {
       ++args;
       if (args == "b64") {
-	Task_IRCam *ir = m_owner_ir.pop();
-	if (ir) {
-	  ir->reset();
-	  origin << *ir;
+	m_pool.publish(m_cam.get_frame());
+	if (&origin == &m_one) {
+	  send_frame(origin, m_task_one, m_owner_one);
+	} else {
+	  send_frame(origin, m_task_zero, m_owner_zero);
 	}
       } else if (args == "ascii") {
 	const float *frame = m_cam.get_frame();
@@ -327,11 +544,138 @@ public:
 	  origin << m_ascii[h] << 0;
 	}
       } else {
-	float ambient = m_cam.get_ambient();
+	bool bFresh = m_cam.update_aux(); // aux words only; otherwise the last subpage's values
+	m_B.clear();
+	if (bFresh) {
+	  m_B.printf("IRCam: Ambient temperature = %.1f degC, Vdd = %.3f V (aux read in %lu us).",
+		     m_cam.get_ambient(), m_cam.get_vdd(), (unsigned long) m_cam.get_timing().aux);
+	} else {
+	  m_B.printf("IRCam: Ambient temperature = %.1f degC, Vdd = %.3f V (last subpage).",
+		     m_cam.get_ambient(), m_cam.get_vdd());
+	}
+	origin << m_B << 0;
+      }
+    } else if (args == "stats") {
+      ++args;
+      if (args == "reset") {
+	m_cam.reset_stats();
+      }
+      const mlx_FrameStats &stats = m_cam.get_stats();
+      m_B.clear();
+      m_B.printf("IRCam: frames=%lu torn=%lu dropped=%lu missed=%lu",
+		 (unsigned long) stats.frames, (unsigned long) stats.torn,
+		 (unsigned long) stats.dropped, (unsigned long) stats.missed);
+      origin << m_B << 0;
+      m_B.clear();
+      m_B.printf("IRCam: i2c errors=%lu retries=%lu abandoned=%lu resets=%lu worst recovery=%lu us",
+		 (unsigned long) stats.errors, (unsigned long) stats.retries, (unsigned long) stats.aborted,
+		 (unsigned long) stats.resets, (unsigned long) stats.recovery_max);
+      origin << m_B << 0;
+      m_B.clear();
+      m_B.printf("IRCam: frames skipped: usb=%lu uart=%lu pool=%lu",
+		 m_task_zero.skipped(), m_task_one.skipped(), m_pool.skipped());
+      origin << m_B << 0;
+    } else if (args == "tune") {
+      ++args;
+      if (args == "off") {
+	m_tuner.enable(false);
+      } else if (args == "rate") {
+	m_tuner.set_priority(MLX90640_TUNE_RATE);
+	m_tuner.enable(true);
+      } else if (args == "noise") {
+	m_tuner.set_priority(MLX90640_TUNE_NOISE);
+	m_tuner.enable(true);
+      }
+      if (m_tuner.enabled()) {
+	const mlx_Timing &timing = m_cam.get_timing();
 	m_B.clear();
-	m_B.printf("IRCam: Ambient temperature = %.1f degC.", ambient);
+	m_B.printf("IRCam: Tuning for %s: %s, %s (read %lu us, calc %lu us, interval %lu us)",
+		   (m_tuner.get_priority() == MLX90640_TUNE_RATE) ? "rate" : "noise",
+		   m_cam.refresh_rate_description(m_cam.cached_refresh_rate()),
+		   m_cam.resolution_description(m_cam.cached_resolution()),
+		   (unsigned long) timing.read, (unsigned long) timing.calc, (unsigned long) timing.interval);
 	origin << m_B << 0;
+      } else {
+	origin << "IRCam: Tuning off" << 0;
+      }
+    } else if (args == "step") {
+      ++args;
+      if (args == "on") {
+	m_tuner.enable(false); // the tuner needs continuous subpages
+	m_cam.step_mode(true);
+      } else if (args == "off") {
+	m_cam.step_mode(false);
+	m_bTriggered = false;
+      } else if (args == "trigger") {
+	if (m_cam.trigger()) {
+	  m_bTriggered = true;
+	} else {
+	  origin << "IRCam: Busy, or not in step mode" << 0;
+	}
+      }
+      m_B.clear();
+      m_B.printf("IRCam: Step mode %s (last capture %lu us)", m_cam.get_step_mode() ? "on" : "off",
+		 (unsigned long) m_cam.get_timing().capture);
+      origin << m_B << 0;
+    } else if (args == "blobs") {
+      ++args;
+      if (args == "on") {
+	m_bBlobs = true;
+      } else if (args == "off") {
+	m_bBlobs = false;
+      } else if (args == "threshold") {
+	m_blobs.set_threshold(m_blobs.get_threshold());
+      } else if (args == "background") {
+	m_blobs.set_background(m_blobs.get_threshold());
+      } else {
+	detect_blobs();
+	send_blobs(origin);
+      }
+      m_B.clear();
+      m_B.printf("IRCam: Blobs %s, %s %.1f degC", m_bBlobs ? "on" : "off",
+		 (m_blobs.get_rule() == MLX90640_BLOB_THRESHOLD) ? "over" : "above background by", m_blobs.get_threshold());
+      origin << m_B << 0;
+    } else if (args == "raw") {
+      ++args;
+      if (args == "on") {
+	m_cam.passthrough_mode(true);
+	publish_calibration();
+      } else if (args == "off") {
+	m_cam.passthrough_mode(false);
+      } else if (args == "calibration") {
+	publish_calibration();
+	if (&origin == &m_one) {
+	  send_frame(origin, m_task_one, m_owner_one);
+	} else {
+	  send_frame(origin, m_task_zero, m_owner_zero);
+	}
+      }
+      if (m_cam.get_passthrough_mode())
+	origin << "IRCam: Raw passthrough on" << 0;
+      else
+	origin << "IRCam: Raw passthrough off" << 0;
+    } else if (args == "alarm") {
+      ++args;
+      if (args == "on") {
+	m_bAlarms = true;
+      } else if (args == "off") {
+	m_bAlarms = false;
+      } else if (args == "list") {
+	for (int r = 0; r < m_alarms.count(); r++) {
+	  const mlx_AlarmRule &rule = m_alarms.rule(r);
+	  m_B.clear();
+	  m_B.printf("IRCam: alarm %u: %s %.1f degC (-%.1f), cols %u-%u, rows %u-%u, %u pixels, %lu ms%s",
+		     (unsigned) rule.id, (rule.type == MLX90640_ALARM_ABOVE) ? "above" : "below",
+		     rule.threshold, rule.hysteresis, (unsigned) rule.col_min, (unsigned) rule.col_max,
+		     (unsigned) rule.row_min, (unsigned) rule.row_max, (unsigned) rule.count,
+		     (unsigned long) rule.persist, m_alarms.active(r) ? " [active]" : "");
+	  origin << m_B << 0;
+	}
       }
+      if (m_bAlarms)
+	origin << "IRCam: Alarms on" << 0;
+      else
+	origin << "IRCam: Alarms off" << 0;
     } else if (args == "auto") {
       ++args;
       if (args == "on") {
@@ -354,6 +698,7 @@ void setup() {
   delay(500);
 
   serial_zero.begin(115200); // Shell on USB
+  serial_one.begin(921600);  // Shell on Serial1
 
   pinMode(LED_BUILTIN, OUTPUT);
 
@@ -36,6 +36,18 @@ void loop() {
     Serial.print(s_cam.get_ambient());
     Serial.print(" degC, read time = ");
     Serial.print(dt);
-    Serial.println(" us.");
+    Serial.print(" us.");
+
+    uint8_t flags = s_cam.get_frame_flags();
+    if (flags & MLX90640_FRAME_DROPPED) {
+      Serial.print(" [dropped]");
+    }
+    if (flags & MLX90640_FRAME_TORN) {
+      Serial.print(" [torn]");
+    }
+    if (flags & MLX90640_FRAME_UNCHECKED) {
+      Serial.print(" [unchecked]");
+    }
+    Serial.println();
   }
 }
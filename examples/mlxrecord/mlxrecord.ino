@@ -0,0 +1,63 @@
+/* -*- mode: c++ -*-
+ *
+ * Record raw subpages to the SD card of a teensy 4.1, for replay on a host with
+ * test/mlxreplay.cpp. The log format is described in MLXRecord.hh.
+ */
+#include <SD.h>
+
+#include "ClassMLX.hh"
+
+MLX s_cam(Master);
+
+File s_log;
+
+mlx_RecordHeader s_header;
+mlx_RecordFrame  s_frame;
+
+void setup() {
+  while (!Serial);
+  Serial.begin(115200);
+
+  s_cam.begin();
+
+  s_cam.set_mode(MLX90640_CHESS);
+  s_cam.set_refresh_rate(MLX90640_4_HZ);
+  s_cam.set_resolution(MLX90640_ADC_18BIT);
+
+  if (!SD.begin(BUILTIN_SDCARD)) {
+    Serial.println("Unable to access the SD card.");
+    return;
+  }
+
+  char filename[16];
+  for (int i = 0; i < 1000; i++) {
+    snprintf(filename, sizeof(filename), "MLX%03d.MLR", i);
+    if (!SD.exists(filename)) break;
+  }
+  s_log = SD.open(filename, FILE_WRITE);
+  if (!s_log) {
+    Serial.println("Unable to create a log file.");
+    return;
+  }
+  Serial.print("Recording to ");
+  Serial.println(filename);
+
+  s_cam.record_header(s_header);
+  s_log.write(reinterpret_cast<const uint8_t *>(&s_header), sizeof(s_header));
+
+  s_cam.cycle_mode(true);
+}
+
+void loop() {
+  if (s_cam.cycle()) {
+    s_cam.record_frame(s_frame);
+    s_log.write(reinterpret_cast<const uint8_t *>(&s_frame), sizeof(s_frame));
+
+    if ((s_frame.sequence & 0x3F) == 0) { // every 64 subpages or so
+      s_log.flush();
+      Serial.print("Recorded ");
+      Serial.print(s_frame.sequence);
+      Serial.println(" subpages.");
+    }
+  }
+}
@@ -0,0 +1,94 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Just enough of the Arduino core to build ClassMLX on a host (-I test/host).
+ *
+ * Time is virtual: micros() only moves when something calls host_clock_advance() or
+ * host_clock_set(), which the simulated bus does for each transfer. This keeps replays
+ * and simulations deterministic and lets them run much faster than real time.
+ */
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+inline uint32_t &host_clock() { // microseconds
+  static uint32_t clock_us = 0;
+  return clock_us;
+}
+inline void host_clock_advance(uint32_t us) {
+  host_clock() += us;
+}
+inline void host_clock_set(uint32_t us) {
+  host_clock() = us;
+}
+
+inline uint32_t micros() {
+  return host_clock();
+}
+inline uint32_t millis() {
+  return host_clock() / 1000;
+}
+inline void delayMicroseconds(uint32_t us) {
+  host_clock_advance(us);
+}
+inline void delay(uint32_t ms) {
+  host_clock_advance(ms * 1000);
+}
+
+class elapsedMicros {
+private:
+  uint32_t m_start;
+public:
+  elapsedMicros() : m_start(micros()) { }
+
+  operator unsigned long() const {
+    return micros() - m_start;
+  }
+  elapsedMicros &operator=(unsigned long us) {
+    m_start = micros() - us;
+    return *this;
+  }
+};
+
+class HostPrint { // Serial, printing to stderr
+public:
+  void print(const char *str)  { fputs(str, stderr); }
+  void print(char c)           { fputc(c, stderr); }
+  void print(int i)            { fprintf(stderr, "%d", i); }
+  void print(unsigned int u)   { fprintf(stderr, "%u", u); }
+  void print(long l)           { fprintf(stderr, "%ld", l); }
+  void print(unsigned long ul) { fprintf(stderr, "%lu", ul); }
+  void print(double d)         { fprintf(stderr, "%.2f", d); }
+
+  template<typename T> void println(T value) {
+    print(value);
+    println();
+  }
+  void println() {
+    fputc('\n', stderr);
+  }
+  operator bool() const {
+    return true;
+  }
+};
+
+inline HostPrint Serial;
+
+#endif // Arduino_h
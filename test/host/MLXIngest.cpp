@@ -0,0 +1,243 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "MLXIngest.h"
+
+namespace {
+
+const int8_t s_invalid = -1;
+
+struct Base64Table {
+  int8_t value[256];
+
+  Base64Table() {
+    const char *digits = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ=%";
+    memset(value, s_invalid, sizeof(value));
+    for (int i = 0; i < 64; i++) {
+      value[(uint8_t) digits[i]] = i;
+    }
+  }
+};
+
+const Base64Table s_b64;
+
+enum State {
+  s_Wait = 0, // looking for '{'
+  s_Row,      // the row digit
+  s_Pixels,   // 64 digits
+  s_Close     // '}'
+};
+
+} // namespace
+
+struct mlx_ingest {
+  State    state;
+  int      row;
+  int      count;     // digits of the row so far
+  uint16_t code;      // first digit of a pair
+  int      next;      // the row expected next to continue the frame, or -1 if the frame is broken
+  bool     bStarted;  // some rows of a frame have been seen
+  uint32_t sequence;  // of the last frame delivered or dropped
+
+  uint16_t frame[768]; // the frame being assembled
+
+  struct Frame {
+    uint32_t sequence;
+    uint16_t code[768];
+  } queue[mlx_IngestQueue];
+
+  size_t head;  // oldest waiting
+  size_t count_waiting;
+
+  mlx_ingest_stats stats;
+};
+
+static void reset_parser(mlx_ingest *I) {
+  I->state = s_Wait;
+  I->row = 0;
+  I->count = 0;
+  I->code = 0;
+  I->next = 0;
+  I->bStarted = false;
+}
+
+static void end_frame(mlx_ingest *I, bool bComplete) {
+  ++I->sequence;
+
+  if (!bComplete) {
+    ++I->stats.dropped;
+    return;
+  }
+  size_t tail = (I->head + I->count_waiting) % mlx_IngestQueue;
+  if (I->count_waiting == mlx_IngestQueue) { // overwrite the oldest
+    I->head = (I->head + 1) % mlx_IngestQueue;
+    ++I->stats.overflow;
+  } else {
+    ++I->count_waiting;
+  }
+  I->queue[tail].sequence = I->sequence;
+  memcpy(I->queue[tail].code, I->frame, sizeof(I->frame));
+  ++I->stats.frames;
+}
+
+static void end_row(mlx_ingest *I) { // a well-formed row has been read into frame
+  ++I->stats.rows;
+
+  if (I->row == 0) {
+    if (I->bStarted) { // the previous frame never finished
+      end_frame(I, false);
+    }
+    I->bStarted = true;
+    I->next = 1;
+  } else if (I->row == I->next) {
+    ++I->next;
+  } else {
+    I->bStarted = true;
+    I->next = -1;
+  }
+  if (I->row == 23) {
+    end_frame(I, I->next == 24);
+    I->bStarted = false;
+    I->next = 0;
+  }
+}
+
+extern "C" {
+
+mlx_ingest *mlx_ingest_new(void) {
+  mlx_ingest *I = new mlx_ingest;
+  I->sequence = 0;
+  mlx_ingest_reset(I);
+  return I;
+}
+
+void mlx_ingest_free(mlx_ingest *ingest) {
+  delete ingest;
+}
+
+void mlx_ingest_reset(mlx_ingest *ingest) {
+  reset_parser(ingest);
+  memset(ingest->frame, 0, sizeof(ingest->frame));
+  ingest->head = 0;
+  ingest->count_waiting = 0;
+  memset(&ingest->stats, 0, sizeof(ingest->stats));
+}
+
+size_t mlx_ingest_feed(mlx_ingest *ingest, const uint8_t *data, size_t length) {
+  mlx_ingest *I = ingest;
+  const uint8_t *end = data + length;
+
+  I->stats.bytes += length;
+
+  while (data < end) {
+    switch (I->state) {
+    case s_Wait: {
+      const uint8_t *brace = static_cast<const uint8_t *>(memchr(data, '{', end - data));
+      if (!brace) {
+	data = end;
+	break;
+      }
+      data = brace + 1;
+      I->state = s_Row;
+      break;
+    }
+    case s_Row: {
+      int8_t value = s_b64.value[*data];
+      if (value < 0 || value > 23) { // not a row, e.g., an alarm or blob report: skip quietly
+	I->state = s_Wait;
+	break;
+      }
+      ++data;
+      I->row = value;
+      I->count = 0;
+      I->state = s_Pixels;
+      break;
+    }
+    case s_Pixels: {
+      uint16_t *pixel = I->frame + 32 * I->row;
+
+      if (!(I->count & 1) && end - data >= 64 - I->count) { // fast path: the rest of the row is here
+	for (; I->count < 64; I->count += 2, data += 2) {
+	  int hi = s_b64.value[data[0]];
+	  int lo = s_b64.value[data[1]];
+	  if ((hi | lo) < 0) break;
+	  pixel[I->count >> 1] = (uint16_t) (hi << 6 | lo);
+	}
+	if (I->count == 64) {
+	  I->state = s_Close;
+	  break;
+	}
+      }
+      int8_t value = s_b64.value[*data];
+      if (value < 0) {
+	++I->stats.resyncs;
+	I->state = s_Wait; // don't consume it: it may be the next '{'
+	break;
+      }
+      ++data;
+      if (I->count & 1) {
+	pixel[I->count >> 1] = (uint16_t) (I->code << 6 | value);
+      } else {
+	I->code = value;
+      }
+      if (++I->count == 64) {
+	I->state = s_Close;
+      }
+      break;
+    }
+    case s_Close:
+      if (*data == '}') {
+	++data;
+	end_row(I);
+      } else {
+	++I->stats.resyncs;
+      }
+      I->state = s_Wait;
+      break;
+    }
+  }
+  return I->count_waiting;
+}
+
+int mlx_ingest_frame(mlx_ingest *ingest, float *temperatures, uint16_t *codes, uint32_t *sequence) {
+  mlx_ingest *I = ingest;
+  if (!I->count_waiting) {
+    return 0;
+  }
+  const mlx_ingest::Frame &F = I->queue[I->head];
+
+  if (temperatures) {
+    for (int p = 0; p < 768; p++) {
+      temperatures[p] = F.code[p] / 16.0f - 40;
+    }
+  }
+  if (codes) {
+    memcpy(codes, F.code, sizeof(F.code));
+  }
+  if (sequence) {
+    *sequence = F.sequence;
+  }
+  I->head = (I->head + 1) % mlx_IngestQueue;
+  --I->count_waiting;
+  return 1;
+}
+
+void mlx_ingest_get_stats(const mlx_ingest *ingest, mlx_ingest_stats *stats) {
+  *stats = ingest->stats;
+}
+
+} // extern "C"
@@ -0,0 +1,77 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MLXIngest_H
+#define MLXIngest_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Host-side parser for the IRCam serial protocol (see MLXEncode.hh), with a plain C ABI
+ * so that it can be loaded from Python with ctypes (see test/mlxingest.py).
+ *
+ * Bytes are fed in as they arrive, in pieces of any size; rows may be split anywhere.
+ * Anything that is not a well-formed row ({R<64 Base64>}) is skipped: on an unexpected
+ * character the parser drops the row and looks for the next '{'. A frame is delivered
+ * when row 23 completes a run of rows 0-23 in order; a frame with missing or corrupt rows
+ * is dropped, but still uses up a sequence number. Up to mlx_IngestQueue frames are queued;
+ * if the caller falls behind, the oldest is overwritten (and counted in overflow). Gaps in
+ * the sequence are therefore frames damaged on the link, or cut short by the device for a
+ * newer one, or overwritten here. The sequence is counted here, not sent by the device, so
+ * frames the device never started on this stream (skipped by MLXFramePool because the
+ * stream was still busy) leave no gap.
+ *
+ * Build as a shared library, from the repository root:
+ *   g++ -std=c++17 -O2 -shared -fPIC -o libmlxingest.so test/host/MLXIngest.cpp
+ */
+
+#define mlx_IngestQueue 16
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mlx_ingest mlx_ingest;
+
+typedef struct mlx_ingest_stats {
+  uint64_t bytes;    // fed in
+  uint64_t rows;     // well-formed rows
+  uint64_t frames;   // delivered
+  uint64_t dropped;  // frames with missing or corrupt rows
+  uint64_t resyncs;  // rows abandoned on an unexpected character
+  uint64_t overflow; // frames overwritten before the caller took them
+} mlx_ingest_stats;
+
+mlx_ingest *mlx_ingest_new(void);
+void mlx_ingest_free(mlx_ingest *ingest);
+void mlx_ingest_reset(mlx_ingest *ingest); // forget any partial frame and queued frames, and zero the stats
+
+/* Parses length bytes; returns the number of frames now waiting.
+ */
+size_t mlx_ingest_feed(mlx_ingest *ingest, const uint8_t *data, size_t length);
+
+/* Takes the oldest waiting frame: 768 temperatures in degC, row by row, into temperatures
+ * and/or the 768 12-bit codes into codes (either may be NULL), and its sequence number
+ * into sequence (may be NULL). Returns 1, or 0 if no frame is waiting.
+ */
+int mlx_ingest_frame(mlx_ingest *ingest, float *temperatures, uint16_t *codes, uint32_t *sequence);
+
+void mlx_ingest_get_stats(const mlx_ingest *ingest, mlx_ingest_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MLXIngest_H
@@ -0,0 +1,83 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "MLXLog.hh"
+
+MLXLog::MLXLog() :
+  m_map(0),
+  m_length(0),
+  m_count(0)
+{
+  // ...
+}
+
+MLXLog::~MLXLog() {
+  close();
+}
+
+bool MLXLog::open(const char *filename) {
+  close();
+
+  int fd = ::open(filename, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "%s: unable to open for reading\n", filename);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) || (size_t) st.st_size < sizeof(mlx_RecordHeader)) {
+    fprintf(stderr, "%s: too short for a raw-frame log\n", filename);
+    ::close(fd);
+    return false;
+  }
+  void *map = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "%s: unable to map file\n", filename);
+    return false;
+  }
+  m_map = static_cast<const unsigned char *>(map);
+  m_length = st.st_size;
+
+  const mlx_RecordHeader &H = header();
+
+  if (memcmp(H.magic, mlx_RecordMagic, 4) || H.version != mlx_RecordVersion ||
+      H.header_size != sizeof(mlx_RecordHeader) || H.frame_size != sizeof(mlx_RecordFrame)) {
+    fprintf(stderr, "%s: not a raw-frame log, or an unsupported version\n", filename);
+    close();
+    return false;
+  }
+  m_count = (m_length - sizeof(mlx_RecordHeader)) / sizeof(mlx_RecordFrame);
+
+  madvise(map, m_length, MADV_SEQUENTIAL);
+
+  return true;
+}
+
+void MLXLog::close() {
+  if (m_map) {
+    munmap(const_cast<unsigned char *>(m_map), m_length);
+  }
+  m_map = 0;
+  m_length = 0;
+  m_count = 0;
+}
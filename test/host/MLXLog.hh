@@ -0,0 +1,49 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MLXLog_HH
+#define MLXLog_HH
+
+#include <stddef.h>
+
+#include "MLXRecord.hh"
+
+/* Read-only, memory-mapped view of a raw-frame log (see MLXRecord.hh).
+ */
+class MLXLog {
+private:
+  const unsigned char *m_map;
+  size_t m_length;
+  size_t m_count;
+
+public:
+  MLXLog();
+  ~MLXLog();
+
+  bool open(const char *filename); // prints the reason to stderr on failure
+  void close();
+
+  const mlx_RecordHeader &header() const {
+    return *reinterpret_cast<const mlx_RecordHeader *>(m_map);
+  }
+  size_t count() const { // number of complete frames
+    return m_count;
+  }
+  const mlx_RecordFrame &frame(size_t index) const {
+    return reinterpret_cast<const mlx_RecordFrame *>(m_map + sizeof(mlx_RecordHeader))[index];
+  }
+};
+
+#endif // MLXLog_HH
@@ -0,0 +1,112 @@
+/* -*- mode: c++ -*-
+ *
+ * Based on MLX90640 code by Melexis N.V.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MLXReference.hh"
+
+static double s_signed(uint16_t word) {
+  return (word > 32767) ? (double) word - 65536 : (double) word;
+}
+
+double mlx_reference_temperatures(const mlx_Parameters *params, const uint16_t *raw, mlx_Mode mode, mlx_Resolution resolution,
+				  uint16_t subpage, double *result) {
+  const double openair = 8;
+  const double emissivity = 0.95;
+
+  // Supply voltage and ambient temperature
+
+  double resolutionCorrection = pow(2.0, params->resolutionEE) / pow(2.0, resolution);
+
+  double vdd = (resolutionCorrection * s_signed(raw[810]) - params->vdd25) / params->kVdd + 3.3;
+
+  double ptat = s_signed(raw[800]);
+  double ptatArt = (ptat / (ptat * params->alphaPTAT + s_signed(raw[768]))) * pow(2.0, 18);
+
+  double ta = (ptatArt / (1 + params->KvPTAT * (vdd - 3.3)) - params->vPTAT25) / params->KtPTAT + 25;
+  double tr = ta - openair;
+
+  double _ta  = ta - 25;
+  double _vdd = vdd - 3.3;
+
+  double taTr = pow(tr + 273.15, 4) - (pow(tr + 273.15, 4) - pow(ta + 273.15, 4)) / emissivity;
+
+  double alphaCorrR[4];
+  alphaCorrR[0] = 1 / (1 + params->ksTo[0] * 40.0);
+  alphaCorrR[1] = 1;
+  alphaCorrR[2] = 1 + params->ksTo[1] * params->ct[2];
+  alphaCorrR[3] = alphaCorrR[2] * (1 + params->ksTo[2] * (params->ct[3] - params->ct[2]));
+
+  // Gain and compensation pixels
+
+  double gain = params->gainEE / s_signed(raw[778]);
+
+  uint8_t calibrationMode = (mode == MLX90640_CHESS) ? 0x80 : 0x00;
+
+  double cpScale = (1 + params->cpKta * _ta) * (1 + params->cpKv * _vdd);
+
+  double irDataCP[2];
+  irDataCP[0] = s_signed(raw[776]) * gain - params->cpOffset[0] * cpScale;
+  irDataCP[1] = s_signed(raw[808]) * gain - params->cpOffset[1] * cpScale;
+  if (calibrationMode != params->calibrationModeEE) {
+    irDataCP[1] -= params->ilChessC[0] * cpScale;
+  }
+
+  // Object temperatures
+
+  double ktaScale   = pow(2.0, params->ktaScale);
+  double kvScale    = pow(2.0, params->kvScale);
+  double alphaScale = pow(2.0, params->alphaScale);
+
+  for (int p = 0; p < 768; p++) {
+    int row = p / 32;
+    int col = p % 32;
+
+    int ilPattern    = row % 2;
+    int chessPattern = ilPattern ^ (col % 2);
+
+    if (((mode == MLX90640_CHESS) ? chessPattern : ilPattern) != subpage) continue;
+
+    double irData = s_signed(raw[p]) * gain;
+
+    double kta = params->kta[p] / ktaScale;
+    double kv  = params->kv[p] / kvScale;
+
+    irData -= params->offset[p] * (1 + kta * _ta) * (1 + kv * _vdd);
+
+    if (calibrationMode != params->calibrationModeEE) {
+      int conversionPattern = ((p + 2) / 4 - (p + 3) / 4 + (p + 1) / 4 - p / 4) * (1 - 2 * ilPattern);
+      irData += params->ilChessC[2] * (2 * ilPattern - 1) - params->ilChessC[1] * conversionPattern;
+    }
+    irData -= params->tgc * irDataCP[subpage];
+    irData /= emissivity;
+
+    double alpha = mlx_SCALEALPHA * alphaScale / params->alpha[p] * (1 + params->KsTa * _ta);
+
+    double Sx = pow(pow(alpha, 3) * (irData + alpha * taTr), 0.25) * params->ksTo[1];
+    double To = pow(irData / (alpha * (1 - params->ksTo[1] * 273.15) + Sx) + taTr, 0.25) - 273.15;
+
+    int range = 3;
+    if (To < params->ct[1]) {
+      range = 0;
+    } else if (To < params->ct[2]) {
+      range = 1;
+    } else if (To < params->ct[3]) {
+      range = 2;
+    }
+    result[p] = pow(irData / (alpha * alphaCorrR[range] * (1 + params->ksTo[range] * (To - params->ct[range]))) + taTr, 0.25) - 273.15;
+  }
+  return ta;
+}
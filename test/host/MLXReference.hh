@@ -0,0 +1,30 @@
+/* -*- mode: c++ -*-
+ *
+ * Based on MLX90640 code by Melexis N.V.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MLXReference_HH
+#define MLXReference_HH
+
+#include "MLXCalc.hh"
+
+/* The Melexis equations, as in mlx_calculate_temperatures(), written out plainly and
+ * evaluated in double precision: the yardstick for faster kernels. Only the pixels of
+ * the subpage are written. Returns the ambient temperature.
+ */
+double mlx_reference_temperatures(const mlx_Parameters *params, const uint16_t *raw, mlx_Mode mode, mlx_Resolution resolution,
+				  uint16_t subpage, double *result);
+
+#endif // MLXReference_HH
@@ -0,0 +1,243 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "MLXShm.hh"
+
+static uint64_t mlx_shm_now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+MLXShmWriter::MLXShmWriter() :
+  m_header(0),
+  m_slots(0),
+  m_length(0),
+  m_next(0)
+{
+  m_name[0] = 0;
+}
+
+MLXShmWriter::~MLXShmWriter() {
+  close();
+}
+
+bool MLXShmWriter::create(const char *name, const mlx_RecordHeader &record, const mlx_Parameters &params, uint32_t slots) {
+  close();
+
+  if (!slots || strlen(name) >= sizeof(m_name)) {
+    fprintf(stderr, "%s: bad name or ring size\n", name);
+    return false;
+  }
+  shm_unlink(name); // start afresh; anyone still mapping the old one keeps it
+
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "%s: unable to create shared memory\n", name);
+    return false;
+  }
+  size_t length = sizeof(mlx_ShmHeader) + slots * sizeof(mlx_ShmSlot);
+
+  if (ftruncate(fd, length)) {
+    fprintf(stderr, "%s: unable to size shared memory\n", name);
+    ::close(fd);
+    shm_unlink(name);
+    return false;
+  }
+  void *map = mmap(0, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "%s: unable to map shared memory\n", name);
+    shm_unlink(name);
+    return false;
+  }
+  strcpy(m_name, name);
+  m_length = length;
+  m_next = 0;
+
+  m_header = static_cast<mlx_ShmHeader *>(map); // zero-filled by ftruncate, so all generations are 0
+  m_slots  = reinterpret_cast<mlx_ShmSlot *>(m_header + 1);
+
+  m_header->version     = mlx_ShmVersion;
+  m_header->header_size = sizeof(mlx_ShmHeader);
+  m_header->slot_size   = sizeof(mlx_ShmSlot);
+  m_header->slots       = slots;
+  m_header->record      = record;
+  m_header->params      = params;
+  m_header->closed.store(0, std::memory_order_relaxed);
+  m_header->published.store(0, std::memory_order_relaxed);
+
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(m_header->magic, mlx_ShmMagic, 4); // last, so that a reader never sees half a header
+
+  return true;
+}
+
+void MLXShmWriter::close() {
+  if (m_header) {
+    m_header->closed.store(1, std::memory_order_release);
+    munmap(m_header, m_length);
+    shm_unlink(m_name);
+  }
+  m_header = 0;
+  m_slots  = 0;
+  m_length = 0;
+  m_name[0] = 0;
+}
+
+mlx_ShmFrame &MLXShmWriter::begin() {
+  mlx_ShmSlot &slot = m_slots[m_next % m_header->slots];
+  slot.generation.store(2 * m_next + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release); // the odd generation is seen before any new data
+  return slot.frame;
+}
+
+void MLXShmWriter::commit() {
+  mlx_ShmSlot &slot = m_slots[m_next % m_header->slots];
+  slot.frame.index = m_next;
+  slot.frame.publish_ns = mlx_shm_now_ns();
+  slot.generation.store(2 * m_next + 2, std::memory_order_release);
+  m_header->published.store(++m_next, std::memory_order_release);
+}
+
+MLXShmReader::MLXShmReader() :
+  m_header(0),
+  m_slots(0),
+  m_length(0),
+  m_next(0),
+  m_lost(0)
+{
+  // ...
+}
+
+MLXShmReader::~MLXShmReader() {
+  close();
+}
+
+bool MLXShmReader::open(const char *name) {
+  close();
+
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) {
+    fprintf(stderr, "%s: no such shared memory\n", name);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) || (size_t) st.st_size < sizeof(mlx_ShmHeader)) {
+    fprintf(stderr, "%s: too short for a frame ring\n", name);
+    ::close(fd);
+    return false;
+  }
+  void *map = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "%s: unable to map shared memory\n", name);
+    return false;
+  }
+  m_header = static_cast<const mlx_ShmHeader *>(map);
+  m_slots  = reinterpret_cast<const mlx_ShmSlot *>(m_header + 1);
+  m_length = st.st_size;
+
+  const mlx_ShmHeader &H = header();
+
+  bool bMagic = !memcmp(H.magic, mlx_ShmMagic, 4);
+  std::atomic_thread_fence(std::memory_order_acquire);
+
+  if (!bMagic || H.version != mlx_ShmVersion || H.header_size != sizeof(mlx_ShmHeader) ||
+      H.slot_size != sizeof(mlx_ShmSlot) || m_length != H.header_size + (size_t) H.slots * H.slot_size) {
+    fprintf(stderr, "%s: not a frame ring, or an unsupported version\n", name);
+    close();
+    return false;
+  }
+  uint64_t count = published();
+  m_next = count ? count - 1 : 0;
+  m_lost = 0;
+
+  return true;
+}
+
+void MLXShmReader::close() {
+  if (m_header) {
+    munmap(const_cast<mlx_ShmHeader *>(m_header), m_length);
+  }
+  m_header = 0;
+  m_slots  = 0;
+  m_length = 0;
+}
+
+mlx_ShmStatus MLXShmReader::acquire(uint64_t index, const mlx_ShmFrame *&frame) const {
+  if (index >= published()) {
+    return MLX90640_SHM_PENDING;
+  }
+  const mlx_ShmSlot &slot = m_slots[index % m_header->slots];
+  uint64_t generation = slot.generation.load(std::memory_order_acquire);
+
+  if (generation == 2 * index + 2) {
+    frame = &slot.frame;
+    return MLX90640_SHM_READY;
+  }
+  return (generation > 2 * index + 2) ? MLX90640_SHM_OVERWRITTEN : MLX90640_SHM_PENDING;
+}
+
+bool MLXShmReader::release(uint64_t index) const {
+  const mlx_ShmSlot &slot = m_slots[index % m_header->slots];
+  std::atomic_thread_fence(std::memory_order_acquire); // everything read from the frame is read before this
+  return slot.generation.load(std::memory_order_relaxed) == 2 * index + 2;
+}
+
+mlx_ShmStatus MLXShmReader::next(const mlx_ShmFrame *&frame) {
+  mlx_ShmStatus status = acquire(m_next, frame);
+
+  while (status == MLX90640_SHM_OVERWRITTEN) { // fallen behind: skip to the oldest frame still there
+    uint64_t count = published();
+    uint64_t oldest = (count > m_header->slots) ? count - m_header->slots + 1 : 0;
+    if (oldest > m_next) {
+      m_lost += oldest - m_next;
+      m_next = oldest;
+    } else {
+      ++m_lost;
+      ++m_next;
+    }
+    status = acquire(m_next, frame);
+  }
+  return status;
+}
+
+bool MLXShmReader::done() {
+  if (release(m_next++)) {
+    return true;
+  }
+  ++m_lost; // overwritten while being read
+  return false;
+}
+
+bool MLXShmReader::copy(uint64_t index, mlx_ShmFrame &frame) const {
+  const mlx_ShmFrame *F = 0;
+  if (acquire(index, F) != MLX90640_SHM_READY) {
+    return false;
+  }
+  memcpy(&frame, F, sizeof(frame));
+  return release(index);
+}
@@ -0,0 +1,157 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MLXShm_HH
+#define MLXShm_HH
+
+#include <atomic>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ClassMLX.hh"
+
+/* Frame export through POSIX shared memory (shm_open), so that viewers, loggers and the
+ * like can run as separate processes on the host and read frames in place.
+ *
+ * The region is one mlx_ShmHeader (the calibration, written once) followed by a ring of
+ * mlx_ShmSlot. Frames are numbered from 0 in the order published; frame n goes in slot
+ * n % slots. Each slot has a seqlock: its generation is 2n+1 while frame n is being written
+ * and 2n+2 once it is complete, so a reader can tell whether the slot holds the frame it
+ * wants, and afterwards whether the frame was overwritten while it was being read. There is
+ * one writer; readers never write to the region, and there can be any number of them.
+ */
+const char     mlx_ShmMagic[4] = { 'M', 'L', 'X', 'S' };
+const uint16_t mlx_ShmVersion  = 1;
+const uint32_t mlx_ShmSlots    = 16; // default ring size
+
+struct mlx_ShmFrame {
+  uint64_t index;      // publication number, from 0
+  uint64_t publish_ns; // CLOCK_MONOTONIC when published, for measuring latency
+  mlx_RecordFrame record; // timestamp, sequence, control, subpage, flags and RAM image
+  float    ambient;
+  float    vdd;
+  float    T[768];     // all pixels, as MLX::get_frame() after this subpage
+};
+
+struct alignas(64) mlx_ShmSlot {
+  std::atomic<uint64_t> generation; // 0: never written; 2n+1: writing frame n; 2n+2: frame n
+  mlx_ShmFrame frame;
+};
+
+struct alignas(64) mlx_ShmHeader {
+  char     magic[4];    // mlx_ShmMagic
+  uint16_t version;     // mlx_ShmVersion
+  uint16_t reserved;
+  uint32_t header_size; // sizeof(mlx_ShmHeader)
+  uint32_t slot_size;   // sizeof(mlx_ShmSlot)
+  uint32_t slots;
+  std::atomic<uint32_t> closed;    // non-zero once the writer has finished
+  std::atomic<uint64_t> published; // number of frames published
+  mlx_RecordHeader record; // I2C address and EEPROM image
+  mlx_Parameters   params; // calibration extracted from the EEPROM
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared-memory counters must be lock-free");
+
+enum mlx_ShmStatus {
+  MLX90640_SHM_READY = 0,  // the frame is in its slot
+  MLX90640_SHM_PENDING,    // not published yet (or being written)
+  MLX90640_SHM_OVERWRITTEN // gone: the ring has moved on
+};
+
+/* The writer: creates the region (replacing any of the same name) and removes the name
+ * again on close(); readers that have it mapped keep it until they close.
+ */
+class MLXShmWriter {
+private:
+  mlx_ShmHeader *m_header;
+  mlx_ShmSlot   *m_slots;
+  size_t   m_length;
+  uint64_t m_next; // index of the next frame
+  char     m_name[64];
+
+public:
+  MLXShmWriter();
+  ~MLXShmWriter();
+
+  /* name as for shm_open, e.g., "/mlx"; prints the reason to stderr on failure
+   */
+  bool create(const char *name, const mlx_RecordHeader &record, const mlx_Parameters &params, uint32_t slots = mlx_ShmSlots);
+  void close();
+
+  /* In-place publication: begin() returns the next frame's slot, already marked as being
+   * written, with index and publish_ns to be filled in by commit().
+   */
+  mlx_ShmFrame &begin();
+  void commit();
+
+  void publish(const MLX &cam) { // the last subpage calculated by cam
+    mlx_ShmFrame &frame = begin();
+    cam.record_frame(frame.record);
+    frame.ambient = cam.get_ambient();
+    frame.vdd     = cam.get_vdd();
+    memcpy(frame.T, cam.get_frame(), sizeof(frame.T));
+    commit();
+  }
+  uint64_t published() const {
+    return m_next;
+  }
+};
+
+/* A reader. Frames are read in place: acquire() gives a pointer into the ring, and release()
+ * says whether the frame survived until then; if not, whatever was read from it must be
+ * discarded. next() follows the ring, skipping frames that were overwritten before they
+ * could be read; these are counted in lost().
+ */
+class MLXShmReader {
+private:
+  const mlx_ShmHeader *m_header;
+  const mlx_ShmSlot   *m_slots;
+  size_t   m_length;
+  uint64_t m_next; // the frame next() looks for
+  uint64_t m_lost;
+
+public:
+  MLXShmReader();
+  ~MLXShmReader();
+
+  bool open(const char *name); // prints the reason to stderr on failure; starts at the latest frame
+  void close();
+
+  const mlx_ShmHeader &header() const {
+    return *m_header;
+  }
+  uint64_t published() const {
+    return m_header->published.load(std::memory_order_acquire);
+  }
+  bool closed() const { // the writer has finished; nothing more will be published
+    return m_header->closed.load(std::memory_order_acquire);
+  }
+
+  mlx_ShmStatus acquire(uint64_t index, const mlx_ShmFrame *&frame) const;
+  bool release(uint64_t index) const; // true if frame index was not overwritten since acquire()
+
+  mlx_ShmStatus next(const mlx_ShmFrame *&frame); // the next frame in order: READY or PENDING
+  bool done();                                    // release the frame from next(), and move on
+  bool copy(uint64_t index, mlx_ShmFrame &frame) const; // a consistent copy; false if not available
+
+  uint64_t lost() const {
+    return m_lost;
+  }
+};
+
+#endif // MLXShm_HH
@@ -0,0 +1,156 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MLXSim.hh"
+
+MLXSimBus::MLXSimBus(const uint16_t *eeprom, uint8_t address) :
+  m_status(0),
+  m_control(0x1901), // power-on default: chess, 2 Hz, 18 bit, subpages enabled
+  m_pointer(0),
+  m_frequency(100000),
+  m_bytes(0),
+  m_error(I2CError::ok),
+  m_address(address),
+  m_error_rate(0),
+  m_stuck_rate(0),
+  m_random(1),
+  m_bStuck(false),
+  m_injected(0)
+{
+  memcpy(m_eeprom, eeprom, sizeof(m_eeprom));
+  memset(m_ram, 0, sizeof(m_ram));
+}
+
+void MLXSimBus::publish(const uint16_t *raw, uint16_t subpage) {
+  memcpy(m_ram, raw, sizeof(m_ram));
+  m_status = (m_status & ~0x0007) | (subpage & 0x0007) | 0x0008;
+  if (m_control & 0x0002) { // step mode: one measurement per start
+    m_status &= ~0x0020;
+  }
+}
+
+void MLXSimBus::begin(uint32_t frequency) {
+  m_frequency = frequency ? frequency : 100000;
+  m_error = I2CError::ok;
+  m_bStuck = false;
+}
+
+void MLXSimBus::set_error_rate(double rate, double stuck, uint32_t seed) {
+  m_error_rate = (uint32_t) (rate  * 4294967295.0);
+  m_stuck_rate = (uint32_t) (stuck * 4294967295.0);
+  m_random = seed ? seed : 1;
+  m_bStuck = false;
+}
+
+bool MLXSimBus::inject_error() {
+  if (m_bStuck) {
+    ++m_injected;
+    return true;
+  }
+  if (!m_error_rate) return false;
+
+  m_random ^= m_random << 13; // xorshift32
+  m_random ^= m_random >> 17;
+  m_random ^= m_random << 5;
+  if (m_random >= m_error_rate) return false;
+
+  m_random ^= m_random << 13;
+  m_random ^= m_random >> 17;
+  m_random ^= m_random << 5;
+  m_bStuck = (m_random < m_stuck_rate);
+
+  ++m_injected;
+  return true;
+}
+
+void MLXSimBus::transfer_time(size_t num_bytes) { // address byte + data, 9 clocks each
+  uint64_t clocks = 9 * (uint64_t) (num_bytes + 1);
+  host_clock_advance((uint32_t) ((clocks * 1000000 + m_frequency - 1) / m_frequency));
+}
+
+uint16_t MLXSimBus::read_word(uint16_t regaddr) const {
+  if (regaddr >= 0x2400 && regaddr < 0x2400 + 832) {
+    return m_eeprom[regaddr - 0x2400];
+  }
+  if (regaddr >= 0x0400 && regaddr < 0x0400 + 832) {
+    return m_ram[regaddr - 0x0400];
+  }
+  if (regaddr == 0x8000) {
+    return m_status;
+  }
+  if (regaddr == 0x800D) {
+    return m_control;
+  }
+  return 0;
+}
+
+void MLXSimBus::write_word(uint16_t regaddr, uint16_t value) {
+  if (regaddr == 0x8000) { // subpage bits are read-only; writing 0 to bit 3 clears data-ready
+    m_status = (m_status & 0x0007) | (m_status & value & 0x0008) | (value & 0x0030);
+  } else if (regaddr == 0x800D) {
+    m_control = value;
+  }
+}
+
+void MLXSimBus::write_async(uint16_t address, const uint8_t *buffer, size_t num_bytes, bool /* send_stop */) {
+  transfer_time(num_bytes);
+
+  m_bytes = 0;
+  if (address != m_address) {
+    m_error = I2CError::address_nak;
+    return;
+  }
+  if (num_bytes < 2) {
+    m_error = I2CError::invalid_request;
+    return;
+  }
+  if (inject_error()) {
+    m_error = I2CError::data_nak;
+    return;
+  }
+  m_error = I2CError::ok;
+  m_bytes = num_bytes;
+
+  m_pointer = (uint16_t) buffer[0] << 8 | buffer[1];
+
+  uint16_t regaddr = m_pointer;
+  for (size_t i = 2; i + 1 < num_bytes; i += 2) {
+    write_word(regaddr++, (uint16_t) buffer[i] << 8 | buffer[i+1]);
+  }
+}
+
+void MLXSimBus::read_async(uint16_t address, uint8_t *buffer, size_t num_bytes, bool /* send_stop */) {
+  transfer_time(num_bytes);
+
+  m_bytes = 0;
+  if (address != m_address) {
+    m_error = I2CError::address_nak;
+    return;
+  }
+  if (inject_error()) { // the master sees whatever was on the bus
+    memset(buffer, 0xFF, num_bytes);
+    m_error = I2CError::data_nak;
+    return;
+  }
+  m_error = I2CError::ok;
+  m_bytes = num_bytes;
+
+  uint16_t regaddr = m_pointer;
+  for (size_t i = 0; i + 1 < num_bytes; i += 2) {
+    uint16_t value = read_word(regaddr++);
+    buffer[i]   = value >> 8;
+    buffer[i+1] = value & 0xFF;
+  }
+}
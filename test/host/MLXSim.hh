@@ -0,0 +1,107 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MLXSim_HH
+#define MLXSim_HH
+
+#include <Arduino.h>
+#include <i2c_device.h>
+
+/* Simulated MLX90640 on a simulated I2C bus, for running MLX on a host.
+ *
+ * The register map covers the EEPROM (0x2400-0x273F), the RAM (0x0400-0x073F), the status
+ * register (0x8000) and the control register (0x800D). Subpages appear only when the host
+ * calls publish(), so the caller decides the pacing; each transfer advances the virtual
+ * clock (see Arduino.h) by the time it would take on the wire. In step mode (control bit 1)
+ * the sensor measures only once the start bit (status bit 5) is set, and publish() clears
+ * it; measuring() tells the caller whether a subpage is due.
+ */
+class MLXSimBus : public I2CMaster {
+private:
+  uint16_t m_eeprom[832];
+  uint16_t m_ram[832];
+  uint16_t m_status;
+  uint16_t m_control;
+
+  uint16_t m_pointer;   // register address set by the last write
+  uint32_t m_frequency; // bus clock
+  size_t   m_bytes;     // bytes transferred by the last transfer
+  I2CError m_error;
+  uint8_t  m_address;
+
+  uint32_t m_error_rate; // injected errors: chance per transfer, in 1/2^32
+  uint32_t m_stuck_rate; // chance that an injected error hangs the bus until begin()
+  uint32_t m_random;
+  bool     m_bStuck;
+  size_t   m_injected;
+
+public:
+  MLXSimBus(const uint16_t *eeprom, uint8_t address = 0x33);
+
+  virtual ~MLXSimBus() {
+    // ...
+  }
+
+  /* Device side
+   */
+  void publish(const uint16_t *raw, uint16_t subpage); // a new subpage has been measured
+  bool data_ready() const {
+    return m_status & 0x0008;
+  }
+  bool measuring() const { // always, except in step mode when not started
+    return !(m_control & 0x0002) || (m_status & 0x0020);
+  }
+  void set_control(uint16_t control) {
+    m_control = control;
+  }
+  uint16_t get_control() const {
+    return m_control;
+  }
+
+  /* Error injection: each transfer fails (data NAK) with probability rate; a failure hangs
+   * the bus, so that every transfer fails until begin() is called again, with probability
+   * stuck.
+   */
+  void set_error_rate(double rate, double stuck = 0, uint32_t seed = 1);
+  size_t injected() const { // number of transfers failed on purpose
+    return m_injected;
+  }
+
+  /* I2CMaster
+   */
+  virtual void begin(uint32_t frequency);
+  virtual void end() { }
+  virtual bool finished() {
+    return true; // transfers complete immediately, in virtual time
+  }
+  virtual size_t get_bytes_transferred() {
+    return m_bytes;
+  }
+  virtual void write_async(uint16_t address, const uint8_t *buffer, size_t num_bytes, bool send_stop);
+  virtual void read_async(uint16_t address, uint8_t *buffer, size_t num_bytes, bool send_stop);
+
+  virtual I2CError error() {
+    return m_error;
+  }
+
+private:
+  uint16_t read_word(uint16_t regaddr) const;
+  void write_word(uint16_t regaddr, uint16_t value);
+
+  void transfer_time(size_t num_bytes); // advance the virtual clock
+  bool inject_error();                  // decide whether this transfer fails
+};
+
+#endif // MLXSim_HH
@@ -0,0 +1,169 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "MLXSynth.hh"
+#include "MLXTestData.hh"
+
+static const double s_emissivity = 0.95; // as in MLXCalc.cpp
+static const double s_openair    = 8;
+
+void mlx_synth_defaults(mlx_SynthConditions &conditions) {
+  conditions.ta    = 25;
+  conditions.vdd   = 3.3f;
+  conditions.gain  = 1;
+  conditions.cp    = 5;
+  conditions.noise = 0;
+  conditions.mode  = MLX90640_CHESS;
+  conditions.resolution = MLX90640_ADC_18BIT;
+}
+
+static int16_t s_clip(double counts, int &clipped) {
+  long value = lround(counts);
+  if (value > 32767) {
+    ++clipped;
+    return 32767;
+  }
+  if (value < -32768) {
+    ++clipped;
+    return -32768;
+  }
+  return (int16_t) value;
+}
+
+static double s_gaussian(uint32_t &state) { // Box-Muller, from two xorshift32 draws
+  double u1 = (mlx_test_random(state) + 1.0) / 4294967296.0;
+  double u2 = mlx_test_random(state) / 4294967296.0;
+  return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+void mlx_synth_aux(const mlx_Parameters *params, uint16_t *raw, const mlx_SynthConditions &conditions) {
+  float ta  = conditions.ta;
+  float vdd = conditions.vdd;
+
+  float resolutionCorrection = pow(2, (double) params->resolutionEE) / pow(2, (double) conditions.resolution);
+
+  raw[810] = (int16_t) lround((params->kVdd * (vdd - 3.3) + params->vdd25) / resolutionCorrection);
+
+  float ptat = 1711;
+  float ptatArt = ((ta - 25) * params->KtPTAT + params->vPTAT25) * (1 + params->KvPTAT * (vdd - 3.3));
+
+  raw[800] = (uint16_t) ptat;
+  raw[768] = (uint16_t) lround(ptat * pow(2, (double) 18) / ptatArt - ptat * params->alphaPTAT);
+
+  raw[778] = (int16_t) lround(params->gainEE / conditions.gain);
+
+  float _ta  = ta - 25;
+  float _vdd = vdd - 3.3;
+
+  for (int i = 0; i < 2; i++) {
+    float cp = params->cpOffset[i] * (1 + params->cpKta * _ta) * (1 + params->cpKv * _vdd);
+    raw[i ? 808 : 776] = (int16_t) lround((cp + conditions.cp) / conditions.gain);
+  }
+}
+
+static int s_range(const mlx_Parameters *params, double To) {
+  if (To < params->ct[1]) return 0;
+  if (To < params->ct[2]) return 1;
+  if (To < params->ct[3]) return 2;
+  return 3;
+}
+
+int mlx_synthesize(const mlx_Parameters *params, uint16_t *raw, const float *T, const mlx_SynthConditions &conditions,
+		   uint32_t &state) {
+  memset(raw, 0, 832 * sizeof(uint16_t));
+
+  mlx_synth_aux(params, raw, conditions);
+
+  /* Decode the aux words as the calculation will, so that the pixels are solved for with
+   * exactly the frame constants it will use.
+   */
+  float vdd = mlx_get_Vdd(params, raw, conditions.resolution);
+  float ta  = mlx_calculate_ambient(params, raw, vdd);
+
+  double _ta  = ta - 25;
+  double _vdd = vdd - 3.3;
+
+  double ta4 = pow(ta + 273.15, 4);
+  double tr4 = pow(ta - s_openair + 273.15, 4);
+  double taTr = tr4 - (tr4 - ta4) / s_emissivity;
+
+  double gain = params->gainEE / (double) (int16_t) raw[778];
+
+  bool bCalMatch = (((conditions.mode == MLX90640_CHESS) ? 0x80 : 0x00) == params->calibrationModeEE);
+
+  double irDataCP[2];
+  for (int i = 0; i < 2; i++) {
+    double cpOffset = params->cpOffset[i] + ((i && !bCalMatch) ? params->ilChessC[0] : 0);
+    irDataCP[i] = (int16_t) raw[i ? 808 : 776] * gain - cpOffset * (1 + params->cpKta * _ta) * (1 + params->cpKv * _vdd);
+  }
+
+  double ktaScale   = pow(2, (double) params->ktaScale);
+  double kvScale    = pow(2, (double) params->kvScale);
+  double alphaScale = pow(2, (double) params->alphaScale);
+
+  double alphaCorrR[4];
+  alphaCorrR[0] = 1 / (1 + params->ksTo[0] * 40);
+  alphaCorrR[1] = 1;
+  alphaCorrR[2] = (1 + params->ksTo[1] * params->ct[2]);
+  alphaCorrR[3] = alphaCorrR[2] * (1 + params->ksTo[2] * (params->ct[3] - params->ct[2]));
+
+  int clipped = 0;
+
+  for (int p = 0; p < 768; p++) {
+    int ilPattern    = p / 32 - (p / 64) * 2;
+    int chessPattern = ilPattern ^ (p - (p / 2) * 2);
+    int conversionPattern = ((p + 2) / 4 - (p + 3) / 4 + (p + 1) / 4 - p / 4) * (1 - 2 * ilPattern);
+
+    int subpage = (conditions.mode == MLX90640_CHESS) ? chessPattern : ilPattern;
+
+    double alphaCompensated = mlx_SCALEALPHA * alphaScale / params->alpha[p];
+    alphaCompensated *= (1 + params->KsTa * _ta);
+
+    double To = T[p];
+    double To4 = pow(To + 273.15, 4) - taTr;
+
+    /* The calculation makes a first estimate of To, and uses it both to pick the range and
+     * in the range's sensitivity correction; so solve for S by fixed-point iteration, from
+     * the target To as the first guess at the estimate; it converges in a few rounds.
+     */
+    double estimate = To;
+    double S = 0;
+    for (int i = 0; i < 4; i++) {
+      int range = s_range(params, estimate);
+      S = alphaCompensated * alphaCorrR[range] * (1 + params->ksTo[range] * (estimate - params->ct[range])) * To4;
+
+      double Sx = alphaCompensated * alphaCompensated * alphaCompensated * (S + alphaCompensated * taTr);
+      Sx = sqrt(sqrt(Sx)) * params->ksTo[1];
+      estimate = sqrt(sqrt(S / (alphaCompensated * (1 - params->ksTo[1] * 273.15) + Sx) + taTr)) - 273.15;
+    }
+
+    double irData = S * s_emissivity + params->tgc * irDataCP[subpage];
+    if (!bCalMatch) {
+      irData -= params->ilChessC[2] * (2 * ilPattern - 1) - params->ilChessC[1] * conversionPattern;
+    }
+    double kta = params->kta[p] / ktaScale;
+    double kv  = params->kv[p] / kvScale;
+    irData += params->offset[p] * (1 + kta * _ta) * (1 + kv * _vdd);
+
+    double counts = irData / gain;
+    if (conditions.noise > 0) {
+      counts += conditions.noise * s_gaussian(state);
+    }
+    raw[p] = s_clip(counts, clipped);
+  }
+  return clipped;
+}
@@ -0,0 +1,59 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MLXSynth_HH
+#define MLXSynth_HH
+
+#include "MLXCalc.hh"
+
+/* Raw subpages from temperature scenes: the inverse of mlx_calculate_temperatures(), for
+ * ground-truth workloads on the host.
+ *
+ * The aux words are made first (PTAT and VBE for the ambient temperature, Vdd, gain and
+ * the two compensation pixels), then decoded exactly as the calculation will decode them,
+ * and every pixel's raw word is solved for from the decoded frame constants, the pixel's
+ * calibration and the temperature wanted. All 768 pixels are filled, each with the
+ * compensation pixel of its own subpage in the given mode, so one raw image serves as
+ * either subpage. Without noise, converting the result gives back the scene to within the
+ * rounding of the raw words to integers (see test/mlxsynth.cpp for the figures).
+ */
+
+struct mlx_SynthConditions {
+  float ta;         // ambient temperature, degC
+  float vdd;        // supply voltage, V
+  float gain;       // gain drift: raw[778] = gainEE / gain; 1 for none
+  float cp;         // compensation-pixel signal above its offset, counts
+  float noise;      // rms noise added to each pixel, counts; 0 for none
+  mlx_Mode mode;
+  mlx_Resolution resolution;
+};
+
+/* Typical conditions: 25 degC, 3.3 V, no gain drift, 5 counts on the compensation pixels,
+ * no noise, chess mode at 18 bits.
+ */
+void mlx_synth_defaults(mlx_SynthConditions &conditions);
+
+/* Fill the aux words of raw (768-831) for the conditions.
+ */
+void mlx_synth_aux(const mlx_Parameters *params, uint16_t *raw, const mlx_SynthConditions &conditions);
+
+/* Fill a whole raw image (832 words) for the scene T (768 degC, row by row). state is the
+ * xorshift32 state for the noise (see mlx_test_random()), and must not be zero. Returns the
+ * number of pixels whose raw word had to be clipped to the 16-bit range.
+ */
+int mlx_synthesize(const mlx_Parameters *params, uint16_t *raw, const float *T, const mlx_SynthConditions &conditions,
+		   uint32_t &state);
+
+#endif // MLXSynth_HH
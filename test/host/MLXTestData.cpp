@@ -0,0 +1,87 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "MLXSynth.hh"
+#include "MLXTestData.hh"
+
+static uint16_t s_word(uint32_t &state, uint16_t base, uint16_t mask) { // vary the bits in mask
+  return (base & ~mask) | (mlx_test_random(state) & mask);
+}
+
+void mlx_test_eeprom(uint16_t *ee, uint32_t seed, bool bChessCalibrated) {
+  uint32_t state = seed ? seed : 1;
+
+  memset(ee, 0, 832 * sizeof(uint16_t));
+
+  ee[10] = bChessCalibrated ? 0x0000 : 0x0800;
+
+  ee[16] = 0x4210;                     // alphaPTAT, offset scales
+  ee[17] = s_word(state, 0xFFC4, 0x0007); // offset reference
+  for (int i = 18; i < 32; i++) {      // offset row & column corrections
+    ee[i] = s_word(state, 0x0000, 0x7777);
+  }
+  ee[32] = 0x6332;                     // alpha scales
+  ee[33] = s_word(state, 0x2FAF, 0x00FF); // alpha reference
+  for (int i = 34; i < 48; i++) {      // alpha row & column corrections
+    ee[i] = s_word(state, 0x0000, 0x3333);
+  }
+  ee[48] = s_word(state, 0x18EF, 0x000F); // gain
+  ee[49] = 0x2FF1;                     // vPTAT25
+  ee[50] = 0x5952;                     // KvPTAT, KtPTAT
+  ee[51] = 0x9D68;                     // kVdd, vdd25
+  ee[52] = s_word(state, 0x4444, 0x1111); // Kv
+  ee[53] = 0xF101;                     // ilChessC
+  ee[54] = s_word(state, 0x5350, 0x0F0F); // Kta
+  ee[55] = s_word(state, 0x5151, 0x0F0F);
+  ee[56] = 0x2363;                     // resolution, Kv & Kta scales
+  ee[57] = 0x04E6;                     // compensation pixel alpha
+  ee[58] = 0xFFB5;                     // compensation pixel offset
+  ee[59] = 0x0C0C;                     // compensation pixel Kv & Kta
+  ee[60] = 0xF000;                     // KsTa, TGC
+  ee[61] = 0x9797;                     // KsTo
+  ee[62] = 0x9797;
+  ee[63] = 0x2889;                     // corner temperatures, KsTo scale
+
+  for (int p = 0; p < 768; p++) {      // offset | alpha | kta | not an outlier
+    uint32_t r = mlx_test_random(state);
+    uint16_t word = ((r & 0x3F) << 10) | (((r >> 6) & 0x3F) << 4) | (((r >> 12) & 0x07) << 1);
+    ee[64 + p] = word ? word : 0x0010; // zero would mark a broken pixel
+  }
+}
+
+void mlx_test_aux(const mlx_Parameters *params, uint16_t *raw, mlx_Resolution resolution, float ta, float vdd) {
+  mlx_SynthConditions conditions;
+  mlx_synth_defaults(conditions);
+  conditions.ta  = ta;
+  conditions.vdd = vdd;
+  conditions.resolution = resolution;
+
+  mlx_synth_aux(params, raw, conditions);
+}
+
+void mlx_test_raw(const mlx_Parameters *params, uint16_t *raw, mlx_Resolution resolution, float ta, float vdd, uint32_t seed) {
+  uint32_t state = seed ? seed : 1;
+
+  memset(raw, 0, 832 * sizeof(uint16_t));
+
+  mlx_test_aux(params, raw, resolution, ta, vdd);
+
+  for (int p = 0; p < 768; p++) {
+    int signal = (int) (mlx_test_random(state) % 2801) - 300;
+    raw[p] = (int16_t) (params->offset[p] + signal);
+  }
+}
@@ -0,0 +1,48 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MLXTestData_HH
+#define MLXTestData_HH
+
+#include "MLXCalc.hh"
+
+/* Deterministic test inputs for host programs: plausible EEPROM images, built around the
+ * worked example in the MLX90640 datasheet and varied by seed, and raw subpages to go
+ * with them.
+ */
+
+inline uint32_t mlx_test_random(uint32_t &state) { // xorshift32; state must not be zero
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+/* Fill an 832-word EEPROM image. bChessCalibrated selects the calibration mode, so that
+ * both the matching and the mismatching (ilChessC-corrected) paths can be exercised.
+ */
+void mlx_test_eeprom(uint16_t *ee, uint32_t seed, bool bChessCalibrated);
+
+/* Fill the auxiliary words of a raw subpage (PTAT, VBE, Vdd, gain, compensation pixels)
+ * so that they decode to roughly the given ambient temperature and supply voltage.
+ */
+void mlx_test_aux(const mlx_Parameters *params, uint16_t *raw, mlx_Resolution resolution, float ta, float vdd);
+
+/* Fill a whole raw subpage: aux words as above, and every pixel with a random signal of
+ * -300..2500 counts above its offset, which comes to roughly 10..130 degC.
+ */
+void mlx_test_raw(const mlx_Parameters *params, uint16_t *raw, mlx_Resolution resolution, float ta, float vdd, uint32_t seed);
+
+#endif // MLXTestData_HH
@@ -0,0 +1,55 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Host stand-in for the I2CMaster interface of teensy4_i2c; see MLXSim.hh for a device.
+ */
+
+#ifndef i2c_device_h
+#define i2c_device_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum class I2CError {
+  ok = 0,
+  arbitration_lost,
+  buffer_overflow,
+  buffer_underflow,
+  invalid_request,
+  master_pin_low_timeout,
+  master_not_ready,
+  master_fifo_error,
+  master_fifos_not_empty,
+  address_nak,
+  data_nak,
+  bit_error
+};
+
+class I2CMaster {
+public:
+  virtual ~I2CMaster() { }
+
+  virtual void begin(uint32_t frequency) = 0;
+  virtual void end() = 0;
+  virtual bool finished() = 0;
+  virtual size_t get_bytes_transferred() = 0;
+  virtual void write_async(uint16_t address, const uint8_t *buffer, size_t num_bytes, bool send_stop) = 0;
+  virtual void read_async(uint16_t address, uint8_t *buffer, size_t num_bytes, bool send_stop) = 0;
+
+  inline bool has_error() { return error() != I2CError::ok; }
+  virtual I2CError error() = 0;
+};
+
+#endif // i2c_device_h
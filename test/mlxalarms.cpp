@@ -0,0 +1,267 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* mlxalarms: MLXAlarms rules on scripted frame sequences.
+ *
+ * Build, from the repository root:
+ *   g++ -std=c++17 -O2 -I test/host -I . -o mlxalarms test/mlxalarms.cpp MLXAlarm.cpp
+ *
+ * Usage:
+ *   mlxalarms
+ *
+ * Each case is run for an ABOVE rule and, with the temperatures mirrored about the
+ * background, for a BELOW rule: the region is columns 4-11, rows 2-9, 4 pixels must be
+ * 10 degC beyond the background, the hysteresis is 2 degC and the persistence 1 s. The
+ * cases: fewer than the minimum pixel count never raise; the count must hold for the whole
+ * persistence, and a break in it starts the wait again; pixels within the hysteresis keep
+ * the alarm raised, and it clears, with one event, once they have been out of it for the
+ * persistence; pixels just outside the region don't count, those on its edges do; and
+ * set_threshold() keeps the rule's state, so a raised alarm is cleared by evaluate() with
+ * an event rather than silently, while add() starts the rule again. The exit status is 1
+ * if any event, or its absence, differs from what is expected.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MLXAlarm.hh"
+
+static const float s_background = 25;
+
+static int s_failures = 0;
+
+struct Case {
+  const char   *name;
+  mlx_AlarmType type;
+  float         sign;  // +1 for ABOVE, -1 for BELOW
+  MLXAlarms     alarms;
+  float         frame[768];
+  mlx_AlarmEvent events[mlx_AlarmRules];
+
+  Case(const char *case_name, mlx_AlarmType alarm_type) :
+    name(case_name),
+    type(alarm_type),
+    sign((alarm_type == MLX90640_ALARM_BELOW) ? -1 : 1)
+  {
+    mlx_AlarmRule rule = { 1, (uint8_t) type, 4, 11, 2, 9, 4, s_background + sign * 10, 2, 1000 };
+    alarms.add(rule);
+    background();
+  }
+
+  const char *type_name() const {
+    return (type == MLX90640_ALARM_BELOW) ? "below" : "above";
+  }
+
+  void background() {
+    for (int p = 0; p < 768; p++) {
+      frame[p] = s_background;
+    }
+  }
+  void set(int col, int row, float delta) { // delta degC beyond the threshold, in the rule's direction
+    frame[row * 32 + col] = s_background + sign * (10 + delta);
+  }
+  void pixels(int n, float delta) { // n pixels along row 5 of the region, the last being the peak
+    background();
+    for (int i = 0; i < n; i++) {
+      set(5 + i, 5, delta + ((i == n - 1) ? 0.5f : 0));
+    }
+  }
+
+  /* Evaluates the frame at time ms and checks the events: none if expect < 0, else one with
+   * bActive == expect, and the alarm's state afterwards.
+   */
+  void check(uint32_t ms, int expect, bool bActive, const char *what) {
+    int n = alarms.evaluate(frame, ms * 1000, events);
+    bool bPass = (expect < 0) ? (n == 0) : (n == 1 && events[0].id == 1 && events[0].bActive == (expect > 0));
+    bPass = bPass && alarms.active(0) == bActive;
+
+    if (bPass && n == 1) { // the event describes the frame
+      const mlx_AlarmEvent &E = events[0];
+      float peak = frame[E.row * 32 + E.col];
+      bPass = E.timestamp == ms * 1000 && E.peak == peak && E.col >= 4 && E.col <= 11 && E.row >= 2 && E.row <= 9;
+      for (int row = 2; row <= 9; row++) {
+	for (int col = 4; col <= 11; col++) {
+	  if (sign * frame[row * 32 + col] > sign * peak) bPass = false;
+	}
+      }
+    }
+    if (!bPass) {
+      fprintf(stderr, "mlxalarms: %s (%s): %s at %lu ms: %d events%s, alarm %s; expected %s, alarm %s\n", name, type_name(), what,
+	      (unsigned long) ms, n, (n && events[0].bActive) ? " (raised)" : (n ? " (cleared)" : ""),
+	      alarms.active(0) ? "raised" : "clear",
+	      (expect < 0) ? "no event" : ((expect > 0) ? "raised" : "cleared"), bActive ? "raised" : "clear");
+      ++s_failures;
+    }
+  }
+};
+
+static void minimum_count(mlx_AlarmType type) {
+  Case C("minimum count", type);
+
+  C.pixels(3, 5);
+  for (uint32_t ms = 0; ms <= 5000; ms += 500) {
+    C.check(ms, -1, false, "3 pixels");
+  }
+  C.pixels(4, 0); // exactly at the threshold is not beyond it
+  C.check(5500, -1, false, "4 pixels at the threshold");
+  C.check(7000, -1, false, "4 pixels at the threshold");
+
+  C.pixels(4, 5);
+  C.check(8000, -1, false, "4 pixels");
+  C.check(8999, -1, false, "4 pixels");
+  C.check(9000,  1, true,  "4 pixels for 1 s");
+  C.check(9500, -1, true,  "4 pixels, raised");
+  C.pixels(20, 5);
+  C.check(10000, -1, true, "20 pixels, raised");
+}
+
+static void persistence(mlx_AlarmType type) {
+  Case C("persistence", type);
+
+  C.pixels(4, 5);
+  C.check(0,   -1, false, "4 pixels");
+  C.check(600, -1, false, "4 pixels");
+  C.pixels(3, 5);
+  C.check(700, -1, false, "3 pixels");
+  C.pixels(4, 5);
+  C.check(800,  -1, false, "4 pixels again");
+  C.check(1700, -1, false, "4 pixels again");
+  C.check(1800,  1, true,  "4 pixels again for 1 s");
+
+  C.pixels(0, 0);
+  C.check(2000, -1, true,  "none");
+  C.pixels(4, 5);
+  C.check(2900, -1, true,  "4 pixels");
+  C.pixels(0, 0);
+  C.check(3000, -1, true,  "none again");
+  C.check(3999, -1, true,  "none again");
+  C.check(4000,  0, false, "none again for 1 s");
+  C.check(9000, -1, false, "none");
+
+  C.pixels(4, 5); // the timestamp wraps around (about 71.6 minutes)
+  uint32_t wrap = (uint32_t) (0xFFFFFFFFUL / 1000) - 300;
+  C.check(wrap, -1, false, "4 pixels before the timestamp wraps");
+  int n = C.alarms.evaluate(C.frame, (wrap + 1000) * 1000, C.events);
+  if (n != 1 || !C.alarms.active(0)) {
+    fprintf(stderr, "mlxalarms: %s (%s): not raised across the timestamp wrap\n", C.name, C.type_name());
+    ++s_failures;
+  }
+}
+
+static void hysteresis(mlx_AlarmType type) {
+  Case C("hysteresis", type);
+
+  C.pixels(4, 5);
+  C.check(0,    -1, false, "4 pixels");
+  C.check(1000,  1, true,  "4 pixels for 1 s");
+
+  C.pixels(4, -1); // within the hysteresis: still counted
+  for (uint32_t ms = 2000; ms <= 6000; ms += 500) {
+    C.check(ms, -1, true, "4 pixels within the hysteresis");
+  }
+  C.pixels(4, -3); // past threshold - hysteresis: no longer counted
+  C.check(7000, -1, true,  "4 pixels past the hysteresis");
+  C.check(8000,  0, false, "4 pixels past the hysteresis for 1 s");
+  if (C.events[0].count != 0) {
+    fprintf(stderr, "mlxalarms: %s (%s): cleared with count %u, expected 0\n", C.name, C.type_name(), (unsigned) C.events[0].count);
+    ++s_failures;
+  }
+
+  C.pixels(4, -1); // cleared: the full threshold applies again
+  C.check(9000,  -1, false, "4 pixels within the hysteresis");
+  C.check(11000, -1, false, "4 pixels within the hysteresis");
+}
+
+static void region(mlx_AlarmType type) {
+  Case C("region", type);
+
+  C.background(); // a ring just outside the region
+  for (int col = 3; col <= 12; col++) {
+    C.set(col, 1, 20);
+    C.set(col, 10, 20);
+  }
+  for (int row = 1; row <= 10; row++) {
+    C.set(3, row, 20);
+    C.set(12, row, 20);
+  }
+  C.check(0,    -1, false, "pixels outside");
+  C.check(5000, -1, false, "pixels outside");
+
+  C.set(4, 2, 5); // and the four corners of the region
+  C.set(11, 2, 5);
+  C.set(4, 9, 5);
+  C.set(11, 9, 6);
+  C.check(6000, -1, false, "corners");
+  C.check(7000,  1, true,  "corners for 1 s");
+  if (C.events[0].count != 4 || C.events[0].col != 11 || C.events[0].row != 9) {
+    fprintf(stderr, "mlxalarms: %s (%s): %u pixels, peak at (%u, %u); expected 4, at (11, 9)\n", C.name, C.type_name(),
+	    (unsigned) C.events[0].count, (unsigned) C.events[0].col, (unsigned) C.events[0].row);
+    ++s_failures;
+  }
+}
+
+static void threshold(mlx_AlarmType type) {
+  Case C("set_threshold", type);
+  const float raised = s_background + C.sign * 10;
+
+  if (C.alarms.set_threshold(2, raised)) {
+    fprintf(stderr, "mlxalarms: %s (%s): set_threshold() accepted an unknown rule\n", C.name, C.type_name());
+    ++s_failures;
+  }
+
+  C.pixels(4, 5);
+  C.check(0,    -1, false, "4 pixels");
+  C.check(1000,  1, true,  "4 pixels for 1 s");
+
+  C.alarms.set_threshold(1, raised + C.sign * 10); // the pixels are now well short of it
+  if (!C.alarms.active(0) || C.alarms.rule(0).threshold != raised + C.sign * 10) {
+    fprintf(stderr, "mlxalarms: %s (%s): set_threshold() changed the state\n", C.name, C.type_name());
+    ++s_failures;
+  }
+  C.check(1500, -1, true,  "4 pixels, threshold moved away");
+  C.check(2500,  0, false, "4 pixels, threshold moved away for 1 s");
+
+  C.alarms.set_threshold(1, raised); // back: raised again, after the persistence
+  C.check(3000, -1, false, "4 pixels, threshold restored");
+  C.check(4000,  1, true,  "4 pixels, threshold restored for 1 s");
+
+  /* add() replaces the rule and its state: a raised alarm is forgotten without an event.
+   */
+  mlx_AlarmRule rule = C.alarms.rule(0);
+  rule.threshold = raised + C.sign * 10;
+  C.alarms.add(rule);
+  C.check(5000, -1, false, "4 pixels, rule added again");
+  C.check(7000, -1, false, "4 pixels, rule added again");
+}
+
+int main(int argc, char ** /* argv */) {
+  if (argc > 1) {
+    fprintf(stderr, "usage: mlxalarms\n");
+    return 2;
+  }
+  const mlx_AlarmType types[2] = { MLX90640_ALARM_ABOVE, MLX90640_ALARM_BELOW };
+
+  for (mlx_AlarmType type : types) {
+    minimum_count(type);
+    persistence(type);
+    hysteresis(type);
+    region(type);
+    threshold(type);
+  }
+  printf("mlxalarms: 5 cases for ABOVE and BELOW rules: %d failures\n", s_failures);
+
+  return s_failures ? 1 : 0;
+}
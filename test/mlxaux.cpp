@@ -0,0 +1,188 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* mlxaux: MLX::update_aux() between and during subpages on a simulated sensor.
+ *
+ * Build, from the repository root:
+ *   g++ -std=c++17 -O2 -I test/host -I . -o mlxaux test/mlxaux.cpp \
+ *       test/host/MLXSim.cpp test/host/MLXSynth.cpp test/host/MLXTestData.cpp ClassMLX.cpp MLXCalc.cpp
+ *
+ * Usage:
+ *   mlxaux [--subpages N] [--poll US]
+ *
+ * MLX cycles through N subpages (default 200), calling cycle() every US microseconds
+ * (default 1000), each synthesized at its own ambient temperature (15-45 degC) and Vdd
+ * (3.0-3.6 V). Once a subpage is published, before cycle() sees it, update_aux() must
+ * succeed, give Ta and Vdd within 0.05 degC and 5 mV of the synthesized values, take a
+ * small fraction of a subpage read (two transfers against 26), and leave get_raw() and
+ * get_frame() as they were. While the subpage is being read, update_aux() must decline
+ * and leave everything alone. The subpage must then convert exactly as
+ * mlx_calculate_temperatures() does, with the same Ta and Vdd. The exit status is 1 on
+ * any failure.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ClassMLX.hh"
+#include "MLXSim.hh"
+#include "MLXTestData.hh"
+
+static int s_failures = 0;
+
+static void fail(size_t subpage, const char *what) {
+  if (s_failures < 10) {
+    printf("mlxaux: subpage %lu: %s\n", (unsigned long) subpage, what);
+  }
+  ++s_failures;
+}
+
+static void usage() {
+  fprintf(stderr, "usage: mlxaux [--subpages N] [--poll US]\n");
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  size_t subpages = 200;
+  uint32_t poll = 1000;
+
+  for (int a = 1; a < argc; a++) {
+    if (!strcmp(argv[a], "--subpages") && a + 1 < argc) {
+      subpages = strtoul(argv[++a], 0, 10);
+    } else if (!strcmp(argv[a], "--poll") && a + 1 < argc) {
+      poll = strtoul(argv[++a], 0, 10);
+    } else {
+      usage();
+    }
+  }
+  if (!poll) poll = 1;
+
+  uint16_t eeprom[832];
+  mlx_test_eeprom(eeprom, 1, true);
+
+  MLXSimBus bus(eeprom);
+  MLX cam(bus);
+  cam.begin();
+  cam.set_refresh_rate(MLX90640_8_HZ);
+  cam.cycle_mode(true);
+
+  const mlx_Parameters &params = cam.get_parameters();
+  const mlx_Mode mode = mlx_control_mode(bus.get_control());
+  const mlx_Resolution resolution = mlx_control_resolution(bus.get_control());
+
+  static uint16_t raw[832];
+  static uint16_t raw_before[832];
+  static float frame_before[768];
+  static float expected[768];
+
+  uint32_t state = 1;
+  double ta_error = 0;
+  double vdd_error = 0;
+  uint32_t aux_max = 0;
+  uint32_t read_min = 0xFFFFFFFF;
+  size_t declined = 0;
+
+  for (size_t s = 0; s < subpages; s++) {
+    uint16_t subpage = s & 1;
+    float ta  = 15 + (mlx_test_random(state) % 3001) * 0.01f;
+    float vdd = 3.0f + (mlx_test_random(state) % 601) * 0.001f;
+    mlx_test_raw(&params, raw, resolution, ta, vdd, (uint32_t) s + 1);
+
+    memcpy(expected, cam.get_frame(), sizeof(expected));
+    float ta_expected = mlx_calculate_temperatures(&params, raw, mode, resolution, subpage, expected);
+
+    bus.publish(raw, subpage);
+
+    /* Between subpages: the new one is in the sensor's RAM, but MLX hasn't started on it.
+     */
+    memcpy(raw_before, cam.get_raw(), sizeof(raw_before));
+    memcpy(frame_before, cam.get_frame(), sizeof(frame_before));
+
+    if (!cam.update_aux()) {
+      fail(s, "update_aux() declined between subpages");
+    } else {
+      double dt = fabs(cam.get_ambient() - ta);
+      double dv = fabs(cam.get_vdd() - vdd);
+      if (ta_error < dt) ta_error = dt;
+      if (vdd_error < dv) vdd_error = dv;
+      if (dt > 0.05 || dv > 0.005) {
+	char what[96];
+	snprintf(what, sizeof(what), "Ta %.3f, Vdd %.4f; synthesized at %.3f, %.4f", cam.get_ambient(), cam.get_vdd(), ta, vdd);
+	fail(s, what);
+      }
+      if (aux_max < cam.get_timing().aux) {
+	aux_max = cam.get_timing().aux;
+      }
+    }
+    if (memcmp(raw_before, cam.get_raw(), sizeof(raw_before)) || memcmp(frame_before, cam.get_frame(), sizeof(frame_before))) {
+      fail(s, "update_aux() changed get_raw() or get_frame()");
+    }
+
+    /* Read the subpage, trying update_aux() at every call while a read is under way.
+     */
+    bool bCalculated = false;
+    for (int call = 0; call < 1000 && !bCalculated; call++) {
+      bCalculated = cam.cycle();
+      host_clock_advance(poll);
+
+      if (!bCalculated && !bus.data_ready()) { // MLX has cleared data-ready: it is reading rows
+	float ambient = cam.get_ambient();
+	float supply  = cam.get_vdd();
+	uint32_t before = host_clock();
+	if (cam.update_aux()) {
+	  fail(s, "update_aux() accepted while a subpage was being read");
+	  break;
+	}
+	++declined;
+	if (host_clock() != before || cam.get_ambient() != ambient || cam.get_vdd() != supply) {
+	  fail(s, "update_aux() used the bus or changed Ta/Vdd while declining");
+	  break;
+	}
+      }
+    }
+    if (!bCalculated) {
+      fail(s, "the subpage was never calculated");
+      continue;
+    }
+    if (read_min > cam.get_timing().read) {
+      read_min = cam.get_timing().read;
+    }
+
+    /* The subpage converts as if update_aux() had never been called.
+     */
+    if (memcmp(cam.get_raw(), raw, sizeof(raw))) {
+      fail(s, "get_raw() differs from the published subpage");
+    }
+    if (memcmp(cam.get_frame(), expected, sizeof(expected))) {
+      fail(s, "get_frame() differs from mlx_calculate_temperatures()");
+    }
+    if (cam.get_ambient() != ta_expected) {
+      fail(s, "get_ambient() differs from mlx_calculate_temperatures()");
+    }
+    host_clock_advance(20000);
+  }
+
+  printf("mlxaux: %lu subpages: worst error Ta %.4f degC, Vdd %.5f V; update_aux() %lu us at worst, subpage read %lu us at best; declined %lu times mid-read; %d failures\n",
+	 (unsigned long) subpages, ta_error, vdd_error, (unsigned long) aux_max, (unsigned long) read_min,
+	 (unsigned long) declined, s_failures);
+
+  if (aux_max * 8 > read_min) {
+    printf("mlxaux: update_aux() takes more than an eighth of a subpage read\n");
+    ++s_failures;
+  }
+  return s_failures ? 1 : 0;
+}
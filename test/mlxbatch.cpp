@@ -0,0 +1,238 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* mlxbatch: convert raw-frame logs (see MLXRecord.hh) to temperatures on all cores.
+ *
+ * Build, from the repository root:
+ *   g++ -std=c++17 -O2 -pthread -I test/host -I . -o mlxbatch test/mlxbatch.cpp \
+ *       test/host/MLXLog.cpp MLXCalc.cpp
+ *
+ * Usage:
+ *   mlxbatch [--threads N] [--csv FILE | --f32 FILE] LOG...
+ *
+ * Each log is converted in segments. Within a segment, subpages are split into chunks
+ * that are shared out between the threads; a thread that runs out steals chunks from
+ * the back of another's queue. Each chunk is converted in one mlx_calculate_batch() call,
+ * which gives the same results as mlx_calculate_temperatures() on each subpage, and the
+ * half-frames are then merged in order, so the output is bit for bit what mlxreplay
+ * (i.e., MLX::cycle()) gives.
+ */
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MLXCalc.hh"
+#include "MLXLog.hh"
+
+static const size_t s_segment = 4096; // subpages converted before merging and writing
+static const size_t s_chunk   = 32;   // subpages per unit of work
+
+static void usage() {
+  fprintf(stderr, "usage: mlxbatch [--threads N] [--csv FILE | --f32 FILE] LOG...\n");
+  exit(2);
+}
+
+class ChunkQueue {
+private:
+  std::mutex m_lock;
+  std::deque<size_t> m_chunks;
+public:
+  void push(size_t chunk) {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_chunks.push_back(chunk);
+  }
+  bool pop(size_t &chunk) { // owner takes from the front...
+    std::lock_guard<std::mutex> guard(m_lock);
+    if (m_chunks.empty()) return false;
+    chunk = m_chunks.front();
+    m_chunks.pop_front();
+    return true;
+  }
+  bool steal(size_t &chunk) { // ... and thieves from the back
+    std::lock_guard<std::mutex> guard(m_lock);
+    if (m_chunks.empty()) return false;
+    chunk = m_chunks.back();
+    m_chunks.pop_back();
+    return true;
+  }
+};
+
+struct Segment {
+  const MLXLog *log;
+  const mlx_Parameters *params;
+  size_t first;  // index of the first subpage in the log
+  size_t count;
+  float *result; // 768 per subpage; only the subpage's own pixels are written
+};
+
+static void convert_chunk(const Segment &S, size_t chunk) {
+  size_t begin = chunk * s_chunk;
+  size_t end = begin + s_chunk;
+  if (end > S.count) end = S.count;
+
+  mlx_BatchFrame frames[s_chunk];
+  for (size_t i = begin; i < end; i++) {
+    const mlx_RecordFrame &frame = S.log->frame(S.first + i);
+    mlx_BatchFrame &F = frames[i - begin];
+    F.raw        = frame.raw;
+    F.result     = S.result + 768 * i;
+    F.mode       = mlx_control_mode(frame.control);
+    F.resolution = mlx_control_resolution(frame.control);
+    F.subpage    = frame.subpage;
+  }
+  mlx_calculate_batch(S.params, frames, end - begin);
+}
+
+static void worker(const Segment &S, std::vector<ChunkQueue> &queues, size_t id, size_t &converted) {
+  size_t chunk;
+  for (;;) {
+    bool bFound = queues[id].pop(chunk);
+    for (size_t q = 1; !bFound && q < queues.size(); q++) {
+      bFound = queues[(id + q) % queues.size()].steal(chunk);
+    }
+    if (!bFound) break; // nothing is ever added, so everything has been taken
+
+    convert_chunk(S, chunk);
+
+    size_t remaining = S.count - chunk * s_chunk;
+    converted += (remaining < s_chunk) ? remaining : s_chunk;
+  }
+}
+
+int main(int argc, char **argv) {
+  size_t threads = std::thread::hardware_concurrency();
+  const char *csv_name = 0;
+  const char *f32_name = 0;
+  std::vector<const char *> logs;
+
+  for (int a = 1; a < argc; a++) {
+    if (!strcmp(argv[a], "--threads") && a + 1 < argc) {
+      threads = strtoul(argv[++a], 0, 10);
+    } else if (!strcmp(argv[a], "--csv") && a + 1 < argc) {
+      csv_name = argv[++a];
+    } else if (!strcmp(argv[a], "--f32") && a + 1 < argc) {
+      f32_name = argv[++a];
+    } else if (argv[a][0] != '-') {
+      logs.push_back(argv[a]);
+    } else {
+      usage();
+    }
+  }
+  if (logs.empty() || (csv_name && f32_name)) usage();
+  if (!threads) threads = 1;
+
+  FILE *out = 0;
+  if (csv_name) {
+    out = fopen(csv_name, "w");
+  } else if (f32_name) {
+    out = fopen(f32_name, "wb");
+  }
+  if ((csv_name || f32_name) && !out) {
+    fprintf(stderr, "mlxbatch: unable to open output file\n");
+    return 1;
+  }
+
+  std::vector<float> result(768 * s_segment);
+  std::vector<size_t> converted(threads, 0);
+
+  size_t total = 0;
+  double busy = 0; // seconds spent converting, excluding merging and output
+
+  for (const char *name : logs) {
+    MLXLog log;
+    if (!log.open(name)) {
+      return 1;
+    }
+    mlx_Parameters params;
+    float scratch[768];
+    mlx_extract_parameters(log.header().eeprom, &params, scratch);
+
+    float frame[768]; // the merged frame, as MLX keeps it in m_cam
+    memset(frame, 0, sizeof(frame));
+
+    for (size_t first = 0; first < log.count(); first += s_segment) {
+      Segment S;
+      S.log = &log;
+      S.params = &params;
+      S.first = first;
+      S.count = log.count() - first;
+      if (S.count > s_segment) S.count = s_segment;
+      S.result = result.data();
+
+      size_t chunks = (S.count + s_chunk - 1) / s_chunk;
+
+      std::vector<ChunkQueue> queues(threads);
+      for (size_t c = 0; c < chunks; c++) { // contiguous runs, so each thread starts with its own part of the log
+	queues[c * threads / chunks].push(c);
+      }
+
+      auto t0 = std::chrono::steady_clock::now();
+
+      std::vector<std::thread> pool;
+      for (size_t t = 0; t < threads; t++) {
+	pool.emplace_back(worker, std::cref(S), std::ref(queues), t, std::ref(converted[t]));
+      }
+      for (std::thread &t : pool) {
+	t.join();
+      }
+      busy += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+      for (size_t i = 0; i < S.count; i++) {
+	const mlx_RecordFrame &rec = log.frame(first + i);
+	mlx_Mode mode = mlx_control_mode(rec.control);
+
+	const float *T = S.result + 768 * i;
+	for (int p = 0; p < 768; p++) {
+	  if (mlx_pixel_subpage(p, mode) == rec.subpage) {
+	    frame[p] = T[p];
+	  }
+	}
+	if (csv_name) {
+	  for (int row = 0; row < 24; row++) {
+	    fprintf(out, "%d", row);
+	    for (int col = 0; col < 32; col++) {
+	      fprintf(out, ",%.2f", frame[row * 32 + col]);
+	    }
+	    fputc('\n', out);
+	  }
+	} else if (f32_name) {
+	  fwrite(frame, sizeof(float), 768, out);
+	}
+      }
+    }
+    total += log.count();
+  }
+  if (out) fclose(out);
+
+  double fps = busy > 0 ? total / busy : 0;
+
+  size_t cores = std::thread::hardware_concurrency();
+  if (!cores || cores > threads) cores = threads;
+
+  fprintf(stderr, "mlxbatch: %lu subpages in %.3f s on %lu threads: %.0f subpages/s, %.0f subpages/s per core\n",
+	  (unsigned long) total, busy, (unsigned long) threads, fps, fps / cores);
+
+  for (size_t t = 0; t < threads; t++) {
+    fprintf(stderr, "mlxbatch:   thread %lu converted %lu\n", (unsigned long) t, (unsigned long) converted[t]);
+  }
+  return 0;
+}
@@ -0,0 +1,313 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* mlxbench: accuracy and speed of the temperature kernels against a double-precision
+ * reference (MLXReference.cpp).
+ *
+ * Build, from the repository root:
+ *   g++ -std=c++17 -O2 -I test/host -I . -o mlxbench test/mlxbench.cpp \
+ *       test/host/MLXReference.cpp test/host/MLXSynth.cpp test/host/MLXTestData.cpp MLXCalc.cpp
+ *
+ * Usage:
+ *   mlxbench [--repeat N] [--batch N] [--tolerance DEGC] [--truth-tolerance DEGC] [--json FILE]
+ *
+ * Every kernel is run on every case: six EEPROM images (three seeds, each calibrated in
+ * chess and in interleaved mode) x {chess, interleaved} x {16..19 bit} x {subpage 0, 1},
+ * with eight raw subpages per case, synthesized (MLXSynth.hh) from scenes of -30..300 degC
+ * at various ambient temperatures, supply voltages and gains. One JSON object per kernel
+ * and case is written (to stdout by default) with the maximum and RMS error in degC against
+ * the reference, the maximum error against the scene itself, the time per pixel in ns and
+ * the subpages converted per second; a summary goes to stderr. The exit status is 1 if any
+ * kernel's maximum error exceeds the tolerance (0.01 degC), or its error against the scene
+ * the truth tolerance (0.1 degC; the raw words are whole counts, which limits it).
+ *
+ * Speed is measured over batches of N subpages (64), each into its own result, either one
+ * call at a time or, for mlx_calculate_batch(), in one call; the batch must also agree bit
+ * for bit with mlx_calculate_temperatures(), and its speed-up over it is reported.
+ */
+
+#include <chrono>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MLXCalc.hh"
+#include "MLXReference.hh"
+#include "MLXSynth.hh"
+#include "MLXTestData.hh"
+
+typedef float (*mlx_Kernel)(const mlx_Parameters *params, const uint16_t *raw, mlx_Mode mode, mlx_Resolution resolution,
+			    uint16_t subpage, float *result);
+
+typedef void (*mlx_Batch)(const mlx_Parameters *params, mlx_BatchFrame *frames, size_t count);
+
+struct Kernel {
+  const char *name;
+  mlx_Kernel  fn;    // one subpage per call, or...
+  mlx_Batch   batch; // ... the whole batch at once
+};
+
+static const Kernel s_kernels[] = {
+  { "mlx_calculate_temperatures_generic", mlx_calculate_temperatures_generic, 0 },
+  { "mlx_calculate_temperatures",         mlx_calculate_temperatures,         0 },
+  { "mlx_calculate_batch",                0,                                  mlx_calculate_batch }
+};
+
+static const int s_frames = 8; // raw subpages per case
+
+struct Case {
+  uint32_t seed;
+  bool     bChessCalibrated;
+  mlx_Mode mode;
+  mlx_Resolution resolution;
+  uint16_t subpage;
+};
+
+struct Result {
+  double max_error;
+  double truth_error; // against the scene the raw subpages were synthesized from
+  double sum_squares;
+  size_t pixels;
+  size_t nonfinite; // the reference is finite but the kernel isn't, or vice versa
+  size_t mismatched; // batch: pixels not bit for bit those of mlx_calculate_temperatures()
+  double seconds;
+  size_t calls;
+};
+
+static void usage() {
+  fprintf(stderr, "usage: mlxbench [--repeat N] [--batch N] [--tolerance DEGC] [--truth-tolerance DEGC] [--json FILE]\n");
+  exit(2);
+}
+
+static void run_case(const Kernel &K, const Case &C, const mlx_Parameters *params, int repeat, int batch, Result &R) {
+  static uint16_t raw[s_frames][832];
+  static float    scene[s_frames][768];
+  static double   reference[768];
+  static float    checked[s_frames][768];
+  static float    single[768];
+  static std::vector<float> results;
+  static std::vector<mlx_BatchFrame> frames;
+
+  results.resize(768 * batch);
+  frames.resize(batch);
+  for (int b = 0; b < batch; b++) { // the batch cycles through the raw subpages
+    mlx_BatchFrame &F = frames[b];
+    F.raw        = raw[b % s_frames];
+    F.result     = results.data() + 768 * b;
+    F.mode       = C.mode;
+    F.resolution = C.resolution;
+    F.subpage    = C.subpage;
+  }
+
+  for (int f = 0; f < s_frames; f++) {
+    uint32_t state = C.seed * 131 + f + 1;
+    for (int p = 0; p < 768; p++) {
+      scene[f][p] = -30 + 330 * (mlx_test_random(state) % 10000) / 9999.0f;
+    }
+    mlx_SynthConditions conditions;
+    mlx_synth_defaults(conditions);
+    conditions.ta   = 20 + 2.5f * f;
+    conditions.vdd  = 3.3f - 0.01f * f;
+    conditions.gain = 0.98f + 0.005f * f;
+    conditions.mode = C.mode;
+    conditions.resolution = C.resolution;
+    mlx_synthesize(params, raw[f], scene[f], conditions, state);
+  }
+
+  if (K.batch) { // the raw subpages as one batch
+    mlx_BatchFrame check[s_frames];
+    for (int f = 0; f < s_frames; f++) {
+      check[f] = frames[0];
+      check[f].raw    = raw[f];
+      check[f].result = checked[f];
+    }
+    K.batch(params, check, s_frames);
+  }
+  for (int f = 0; f < s_frames; f++) { // accuracy
+    float *result = checked[f];
+    if (K.batch) {
+      mlx_calculate_temperatures(params, raw[f], C.mode, C.resolution, C.subpage, single);
+      for (int p = 0; p < 768; p++) {
+	if (mlx_pixel_subpage(p, C.mode) == C.subpage && memcmp(single + p, result + p, sizeof(float))) {
+	  ++R.mismatched;
+	}
+      }
+    } else {
+      K.fn(params, raw[f], C.mode, C.resolution, C.subpage, result);
+    }
+    mlx_reference_temperatures(params, raw[f], C.mode, C.resolution, C.subpage, reference);
+
+    for (int p = 0; p < 768; p++) {
+      if (mlx_pixel_subpage(p, C.mode) != C.subpage) continue;
+
+      bool bRefFinite = isfinite(reference[p]);
+      bool bResFinite = isfinite(result[p]);
+      if (bRefFinite != bResFinite) {
+	++R.nonfinite;
+      } else if (bRefFinite) {
+	double error = fabs(result[p] - reference[p]);
+	if (R.max_error < error) {
+	  R.max_error = error;
+	}
+	R.sum_squares += error * error;
+	++R.pixels;
+
+	error = fabs(result[p] - scene[f][p]);
+	if (R.truth_error < error) {
+	  R.truth_error = error;
+	}
+      }
+    }
+  }
+
+  auto t0 = std::chrono::steady_clock::now(); // speed
+  for (int r = 0; r < repeat; r++) {
+    if (K.batch) {
+      K.batch(params, frames.data(), batch);
+    } else {
+      for (const mlx_BatchFrame &F : frames) {
+	K.fn(params, F.raw, F.mode, F.resolution, F.subpage, F.result);
+      }
+    }
+  }
+  R.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  R.calls += repeat * batch;
+}
+
+int main(int argc, char **argv) {
+  int repeat = 50;
+  int batch = 64;
+  double tolerance = 0.01;
+  double truth_tolerance = 0.1;
+  const char *json_name = 0;
+
+  for (int a = 1; a < argc; a++) {
+    if (!strcmp(argv[a], "--repeat") && a + 1 < argc) {
+      repeat = atoi(argv[++a]);
+    } else if (!strcmp(argv[a], "--batch") && a + 1 < argc) {
+      batch = atoi(argv[++a]);
+    } else if (!strcmp(argv[a], "--tolerance") && a + 1 < argc) {
+      tolerance = atof(argv[++a]);
+    } else if (!strcmp(argv[a], "--truth-tolerance") && a + 1 < argc) {
+      truth_tolerance = atof(argv[++a]);
+    } else if (!strcmp(argv[a], "--json") && a + 1 < argc) {
+      json_name = argv[++a];
+    } else {
+      usage();
+    }
+  }
+  if (repeat < 1) repeat = 1;
+  if (batch < 1) batch = 1;
+
+  FILE *json = json_name ? fopen(json_name, "w") : stdout;
+  if (!json) {
+    fprintf(stderr, "mlxbench: unable to open %s\n", json_name);
+    return 1;
+  }
+
+  std::vector<Case> cases;
+  for (uint32_t seed = 1; seed <= 3; seed++) {
+    for (int cal = 0; cal < 2; cal++) {
+      for (int mode = 0; mode < 2; mode++) {
+	for (int res = 0; res < 4; res++) {
+	  for (uint16_t subpage = 0; subpage < 2; subpage++) {
+	    Case C;
+	    C.seed = seed;
+	    C.bChessCalibrated = !cal;
+	    C.mode = static_cast<mlx_Mode>(mode);
+	    C.resolution = static_cast<mlx_Resolution>(res);
+	    C.subpage = subpage;
+	    cases.push_back(C);
+	  }
+	}
+      }
+    }
+  }
+
+  bool bRegression = false;
+  double single_seconds = 0; // mlx_calculate_temperatures(), for the batch's speed-up
+
+  for (const Kernel &K : s_kernels) {
+    Result total;
+    memset(&total, 0, sizeof(total));
+
+    for (const Case &C : cases) {
+      uint16_t eeprom[832];
+      mlx_test_eeprom(eeprom, C.seed, C.bChessCalibrated);
+
+      mlx_Parameters params;
+      float scratch[768];
+      mlx_extract_parameters(eeprom, &params, scratch);
+
+      Result R;
+      memset(&R, 0, sizeof(R));
+      run_case(K, C, &params, repeat, batch, R);
+
+      double rms = R.pixels ? sqrt(R.sum_squares / R.pixels) : 0;
+      double ns_per_pixel = 1e9 * R.seconds / (R.calls * 384.0);
+      double fps = R.calls / R.seconds;
+
+      fprintf(json, "{\"kernel\":\"%s\",\"eeprom\":%u,\"calibration\":\"%s\",\"mode\":\"%s\",\"resolution\":%d,\"subpage\":%u,"
+	      "\"batch\":%d,\"max_error\":%.6g,\"rms_error\":%.6g,\"truth_error\":%.6g,\"nonfinite\":%lu,\"mismatched\":%lu,"
+	      "\"ns_per_pixel\":%.3f,\"fps\":%.1f}\n",
+	      K.name, C.seed, C.bChessCalibrated ? "chess" : "interleaved",
+	      (C.mode == MLX90640_CHESS) ? "chess" : "interleaved", 16 + C.resolution, C.subpage, batch,
+	      R.max_error, rms, R.truth_error, (unsigned long) R.nonfinite, (unsigned long) R.mismatched, ns_per_pixel, fps);
+
+      if (total.max_error < R.max_error) {
+	total.max_error = R.max_error;
+      }
+      if (total.truth_error < R.truth_error) {
+	total.truth_error = R.truth_error;
+      }
+      total.sum_squares += R.sum_squares;
+      total.pixels      += R.pixels;
+      total.nonfinite   += R.nonfinite;
+      total.mismatched  += R.mismatched;
+      total.seconds     += R.seconds;
+      total.calls       += R.calls;
+    }
+
+    double rms = total.pixels ? sqrt(total.sum_squares / total.pixels) : 0;
+
+    fprintf(stderr, "%-36s max %.2e degC, rms %.2e degC, %lu non-finite, scene max %.3f degC; %.2f ns/pixel, %.0f subpages/s\n",
+	    K.name, total.max_error, rms, (unsigned long) total.nonfinite, total.truth_error,
+	    1e9 * total.seconds / (total.calls * 384.0), total.calls / total.seconds);
+
+    if (K.fn == mlx_calculate_temperatures) {
+      single_seconds = total.seconds;
+    }
+    if (K.batch && single_seconds > 0) {
+      fprintf(stderr, "%-36s %.2fx mlx_calculate_temperatures() over batches of %d\n", "", single_seconds / total.seconds, batch);
+    }
+    if (total.mismatched) {
+      fprintf(stderr, "mlxbench: %s differs from mlx_calculate_temperatures() in %lu pixels\n", K.name, (unsigned long) total.mismatched);
+      bRegression = true;
+    }
+    if (total.max_error > tolerance || total.nonfinite) {
+      fprintf(stderr, "mlxbench: %s exceeds the tolerance of %g degC\n", K.name, tolerance);
+      bRegression = true;
+    }
+    if (total.truth_error > truth_tolerance) {
+      fprintf(stderr, "mlxbench: %s is further than %g degC from the scene\n", K.name, truth_tolerance);
+      bRegression = true;
+    }
+  }
+  if (json != stdout) fclose(json);
+
+  return bRegression ? 1 : 0;
+}
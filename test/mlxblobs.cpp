@@ -0,0 +1,325 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* mlxblobs: MLXBlobs against a straightforward flood fill.
+ *
+ * Build, from the repository root:
+ *   g++ -std=c++17 -O2 -I test/host -I . -o mlxblobs test/mlxblobs.cpp MLXBlobs.cpp
+ *
+ * Usage:
+ *   mlxblobs [--frames N] [--seed S]
+ *
+ * Each frame is labelled twice, by MLXBlobs::detect() and by a 4-connected flood fill from
+ * every unvisited foreground pixel in raster order, and the blobs must agree: the same
+ * number, in the same order (largest first, ties in raster order of their first pixel, at
+ * most mlx_MaxBlobs), with the same area, bounding box, centroid and peak, the peak's
+ * location being a pixel of the blob at that temperature. The frames are N random frames
+ * (2000) of foreground densities from 5% to 95%, at minimum areas 1-3, then fixed patterns:
+ * empty, all hot, blobs on each edge and corner, diagonal neighbours (which are separate),
+ * a chessboard (384 single pixels, the most labels a frame can need), combs and a spiral
+ * (many provisional labels joined late), and NaN pixels (background). The exit status is 1
+ * on any disagreement.
+ */
+
+#include <chrono>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MLXBlobs.hh"
+#include "MLXTestData.hh"
+
+static const float s_threshold = 30;
+static const float s_hot  = 40;
+static const float s_cold = 20;
+
+struct Reference {
+  int    count;
+  int    label[768]; // component of each pixel, or -1
+  mlx_Blob blob[768];
+};
+
+static void flood_fill(const float *frame, uint16_t min_area, Reference &R) {
+  static int stack[768];
+  static mlx_Blob all[768];
+  static long sum_col[768];
+  static long sum_row[768];
+  int components = 0;
+
+  for (int p = 0; p < 768; p++) {
+    R.label[p] = -1;
+  }
+  for (int start = 0; start < 768; start++) {
+    if (R.label[start] >= 0 || !(frame[start] > s_threshold)) continue;
+
+    int c = components++;
+    mlx_Blob &B = all[c];
+    B.area = 0;
+    B.col_min = 31;
+    B.col_max = 0;
+    B.row_min = 23;
+    B.row_max = 0;
+    B.peak = frame[start];
+    B.peak_col = start % 32;
+    B.peak_row = start / 32;
+    sum_col[c] = 0;
+    sum_row[c] = 0;
+
+    int depth = 0;
+    stack[depth++] = start;
+    R.label[start] = c;
+
+    while (depth) {
+      int p = stack[--depth];
+      int row = p / 32;
+      int col = p % 32;
+
+      ++B.area;
+      sum_col[c] += col;
+      sum_row[c] += row;
+      if (B.col_min > col) B.col_min = col;
+      if (B.col_max < col) B.col_max = col;
+      if (B.row_min > row) B.row_min = row;
+      if (B.row_max < row) B.row_max = row;
+      if (B.peak < frame[p]) {
+	B.peak = frame[p];
+	B.peak_col = col;
+	B.peak_row = row;
+      }
+      const int neighbour[4] = { col > 0 ? p - 1 : -1, col < 31 ? p + 1 : -1, row > 0 ? p - 32 : -1, row < 23 ? p + 32 : -1 };
+      for (int n : neighbour) {
+	if (n >= 0 && R.label[n] < 0 && frame[n] > s_threshold) {
+	  R.label[n] = c;
+	  stack[depth++] = n;
+	}
+      }
+    }
+    B.col = (float) sum_col[c] / B.area;
+    B.row = (float) sum_row[c] / B.area;
+  }
+
+  /* Largest first; a stable sort keeps equal areas in raster order of their first pixel.
+   */
+  R.count = 0;
+  for (int c = 0; c < components; c++) {
+    if (all[c].area < min_area) continue;
+
+    int index = R.count++;
+    while (index > 0 && R.blob[index - 1].area < all[c].area) {
+      R.blob[index] = R.blob[index - 1];
+      --index;
+    }
+    R.blob[index] = all[c];
+  }
+  if (R.count > mlx_MaxBlobs) {
+    R.count = mlx_MaxBlobs;
+  }
+}
+
+static bool compare(const char *name, const float *frame, uint16_t min_area) {
+  static MLXBlobs blobs;
+  static Reference R;
+
+  blobs.set_threshold(s_threshold);
+  blobs.set_min_area(min_area);
+  int count = blobs.detect(frame);
+
+  flood_fill(frame, min_area, R);
+
+  if (count != R.count || blobs.count() != count) {
+    fprintf(stderr, "mlxblobs: %s: %d blobs, expected %d\n", name, count, R.count);
+    return false;
+  }
+  for (int b = 0; b < count; b++) {
+    const mlx_Blob &A = blobs.blob(b);
+    const mlx_Blob &E = R.blob[b];
+
+    bool bSame = A.area == E.area &&
+      A.col_min == E.col_min && A.col_max == E.col_max && A.row_min == E.row_min && A.row_max == E.row_max &&
+      A.col == E.col && A.row == E.row && A.peak == E.peak;
+
+    if (bSame) { // ties for the peak may be resolved either way
+      int p = A.peak_row * 32 + A.peak_col;
+      int e = E.peak_row * 32 + E.peak_col;
+      bSame = A.peak_col < 32 && A.peak_row < 24 && frame[p] == A.peak && R.label[p] == R.label[e];
+    }
+    if (!bSame) {
+      fprintf(stderr, "mlxblobs: %s: blob %d: area %u, cols %u-%u, rows %u-%u, centre (%g, %g), peak %g at (%u, %u); "
+	      "expected area %u, cols %u-%u, rows %u-%u, centre (%g, %g), peak %g\n", name, b,
+	      (unsigned) A.area, (unsigned) A.col_min, (unsigned) A.col_max, (unsigned) A.row_min, (unsigned) A.row_max,
+	      A.col, A.row, A.peak, (unsigned) A.peak_col, (unsigned) A.peak_row,
+	      (unsigned) E.area, (unsigned) E.col_min, (unsigned) E.col_max, (unsigned) E.row_min, (unsigned) E.row_max,
+	      E.col, E.row, E.peak);
+      return false;
+    }
+  }
+  return true;
+}
+
+static void fill(float *frame, float t) {
+  for (int p = 0; p < 768; p++) {
+    frame[p] = t;
+  }
+}
+
+static void rect(float *frame, int col_min, int col_max, int row_min, int row_max, float t) {
+  for (int row = row_min; row <= row_max; row++) {
+    for (int col = col_min; col <= col_max; col++) {
+      frame[row * 32 + col] = t;
+    }
+  }
+}
+
+static int patterns() { // returns the number of failures
+  static float frame[768];
+  int failures = 0;
+
+  fill(frame, s_cold);
+  failures += !compare("empty", frame, 1);
+
+  fill(frame, s_hot);
+  failures += !compare("all hot", frame, 1);
+
+  fill(frame, s_cold); // a strip along each edge, and a pixel in each corner
+  rect(frame, 2, 29,  0,  0, s_hot);
+  rect(frame, 2, 29, 23, 23, s_hot + 1);
+  rect(frame, 0,  0,  2, 21, s_hot + 2);
+  rect(frame, 31, 31, 2, 21, s_hot + 3);
+  frame[0] = frame[31] = frame[736] = frame[767] = s_hot + 4;
+  failures += !compare("edges and corners", frame, 1);
+
+  fill(frame, s_cold); // a frame around the border, one blob
+  rect(frame, 0, 31,  0,  0, s_hot);
+  rect(frame, 0, 31, 23, 23, s_hot);
+  rect(frame, 0,  0,  0, 23, s_hot);
+  rect(frame, 31, 31, 0, 23, s_hot);
+  failures += !compare("border", frame, 1);
+
+  fill(frame, s_cold); // diagonal neighbours are not connected
+  for (int i = 0; i < 24; i++) {
+    frame[i * 32 + i] = s_hot + i;
+    frame[i * 32 + 31 - i] = s_hot + i;
+  }
+  failures += !compare("diagonals", frame, 1);
+
+  for (int p = 0; p < 768; p++) { // every other pixel: 384 labels, none joined
+    frame[p] = (((p / 32) ^ p) & 1) ? s_hot + (p % 97) * 0.1f : s_cold;
+  }
+  failures += !compare("chessboard", frame, 1);
+  failures += !compare("chessboard, min area 2", frame, 2);
+
+  for (int p = 0; p < 768; p++) { // the other chessboard
+    frame[p] = (((p / 32) ^ p) & 1) ? s_cold : s_hot - (p % 89) * 0.1f;
+  }
+  failures += !compare("chessboard 2", frame, 1);
+
+  fill(frame, s_cold); // comb, teeth up: 16 labels joined only on the last row
+  for (int col = 0; col < 32; col += 2) {
+    rect(frame, col, col, 0, 22, s_hot + col);
+  }
+  rect(frame, 0, 31, 23, 23, s_hot);
+  failures += !compare("comb up", frame, 1);
+
+  fill(frame, s_cold); // comb, teeth down, and a second comb beside it
+  for (int col = 0; col < 32; col += 2) {
+    rect(frame, col, col, 1, 23, s_hot + col);
+  }
+  rect(frame, 0, 15, 0, 0, s_hot);
+  rect(frame, 17, 31, 0, 0, s_hot);
+  failures += !compare("combs down", frame, 1);
+
+  fill(frame, s_cold); // a spiral, joined from the inside out
+  int col_min = 0, col_max = 31, row_min = 0, row_max = 23;
+  float t = s_hot;
+  while (col_min <= col_max && row_min <= row_max) {
+    rect(frame, col_min, col_max, row_min, row_min, t += 0.5f);
+    rect(frame, col_max, col_max, row_min, row_max, t += 0.5f);
+    rect(frame, col_min, col_max, row_max, row_max, t += 0.5f);
+    if (row_min + 2 <= row_max) {
+      rect(frame, col_min, col_min, row_min + 2, row_max, t += 0.5f);
+    }
+    col_min += 2;
+    col_max -= 2;
+    row_min += 2;
+    row_max -= 2;
+    if (col_min <= col_max && row_min <= row_max) {
+      frame[(row_min - 1) * 32 + col_min - 2 + 1] = s_hot;
+    }
+  }
+  failures += !compare("spiral", frame, 1);
+
+  fill(frame, s_hot); // NaN pixels are background: a NaN line splits the frame
+  rect(frame, 16, 16, 0, 23, NAN);
+  failures += !compare("NaN", frame, 1);
+
+  return failures;
+}
+
+static void usage() {
+  fprintf(stderr, "usage: mlxblobs [--frames N] [--seed S]\n");
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  size_t frames = 2000;
+  uint32_t seed = 1;
+
+  for (int a = 1; a < argc; a++) {
+    if (!strcmp(argv[a], "--frames") && a + 1 < argc) {
+      frames = strtoul(argv[++a], 0, 10);
+    } else if (!strcmp(argv[a], "--seed") && a + 1 < argc) {
+      seed = strtoul(argv[++a], 0, 10);
+    } else {
+      usage();
+    }
+  }
+  uint32_t state = seed ? seed : 1;
+
+  static float frame[768];
+  int failures = 0;
+
+  for (size_t f = 0; f < frames; f++) {
+    uint32_t density = 5 + (f * 90) / (frames > 1 ? frames - 1 : 1); // percent
+    for (int p = 0; p < 768; p++) {
+      float t = (mlx_test_random(state) % 10000) * 0.001f;
+      frame[p] = (mlx_test_random(state) % 100 < density) ? s_threshold + 0.001f + t : s_threshold - t;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "frame %lu", (unsigned long) f);
+    if (!compare(name, frame, 1 + f % 3)) {
+      ++failures;
+    }
+  }
+  failures += patterns();
+
+  static MLXBlobs blobs; // speed, on a random half-hot frame
+  blobs.set_threshold(s_threshold);
+  for (int p = 0; p < 768; p++) {
+    frame[p] = (mlx_test_random(state) & 1) ? s_hot : s_cold;
+  }
+  const int repeat = 20000;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < repeat; r++) {
+    frame[r % 768] += 0.001f; // so the calls can't be folded together
+    blobs.detect(frame);
+  }
+  double us = 1e6 * std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() / repeat;
+
+  printf("mlxblobs: %lu random frames and the fixed patterns: %d disagreements; %.2f us per frame\n",
+	 (unsigned long) frames, failures, us);
+
+  return failures ? 1 : 0;
+}
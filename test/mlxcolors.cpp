@@ -0,0 +1,269 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* mlxcolors: MLXColor's lookup table and upscaling against test/colors.py.
+ *
+ * Build, from the repository root:
+ *   g++ -std=c++17 -O2 -I test/host -I . -o mlxcolors test/mlxcolors.cpp MLXColor.cpp
+ *
+ * Usage:
+ *   mlxcolors [--colors FILE] [--dump FILE] [--frames N] [--seed S]
+ *
+ * Options:
+ *   --colors FILE  the Python colour map to read color_ranges from (test/colors.py)
+ *   --dump FILE    write the table as CSV: code, temperature, red, green, blue
+ *   --frames N     random frames to render at each scale (200)
+ *
+ * Every one of the 4096 codes is mapped as map_temperatures_to_colors() in colors.py does,
+ * in double precision, and the table must agree to within 1 in each channel (rounding); a
+ * few codes, at the ends and middle of each range, are printed. Then gradient and random
+ * frames are rendered at 1x, 2x and 4x, as RGB888 and RGB565, and each output pixel must be
+ * the table colour of the bilinear interpolation of the codes, rounded to nearest. The exit
+ * status is 1 on any difference.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "MLXColor.hh"
+#include "MLXTestData.hh"
+
+struct Range {
+  int T_min;
+  int rgb_min[3];
+  int T_max;
+  int rgb_max[3];
+};
+
+static Range s_ranges[16];
+static int   s_count = 0;
+
+/* Reads the rows of `color_ranges = [...]`, e.g., `[ 150, (255,255,  0), 216, (255,245,158) ],`
+ */
+static bool read_ranges(const char *name) {
+  FILE *file = fopen(name, "r");
+  if (!file) {
+    fprintf(stderr, "mlxcolors: unable to open %s\n", name);
+    return false;
+  }
+  char line[256];
+  bool bTable = false;
+
+  while (fgets(line, sizeof(line), file)) {
+    if (!bTable) {
+      bTable = !strncmp(line, "color_ranges", 12);
+      continue;
+    }
+    for (char *ptr = line; *ptr; ptr++) {
+      if (strchr("[](),", *ptr)) *ptr = ' ';
+    }
+    Range R;
+    if (sscanf(line, "%d %d %d %d %d %d %d %d", &R.T_min, &R.rgb_min[0], &R.rgb_min[1], &R.rgb_min[2],
+	       &R.T_max, &R.rgb_max[0], &R.rgb_max[1], &R.rgb_max[2]) != 8) {
+      break;
+    }
+    if (s_count == 16) {
+      fprintf(stderr, "mlxcolors: too many colour ranges in %s\n", name);
+      fclose(file);
+      return false;
+    }
+    s_ranges[s_count++] = R;
+  }
+  fclose(file);
+
+  if (!s_count) {
+    fprintf(stderr, "mlxcolors: no colour ranges in %s\n", name);
+    return false;
+  }
+  return true;
+}
+
+static void reference(int code, double rgb[3]) { // as map_temperatures_to_colors(), but 0-255
+  double T = code / 16.0 - 40;
+
+  rgb[0] = rgb[1] = rgb[2] = 0; // default to black
+  for (int r = 0; r < s_count; r++) {
+    const Range &R = s_ranges[r];
+    if (T >= R.T_min && T <= R.T_max) {
+      for (int c = 0; c < 3; c++) {
+	rgb[c] = R.rgb_min[c] + (R.rgb_max[c] - R.rgb_min[c]) * (T - R.T_min) / (R.T_max - R.T_min);
+      }
+      break;
+    }
+  }
+}
+
+static int check_table(const MLXColor &color, FILE *dump) { // returns the number of failures
+  int failures = 0;
+
+  bool bSample[4096] = { false }; // ends and middle of each range, and the ends of the table
+  bSample[0] = bSample[4095] = true;
+  for (int r = 0; r < s_count; r++) {
+    const int T[3] = { s_ranges[r].T_min, (s_ranges[r].T_min + s_ranges[r].T_max) / 2, s_ranges[r].T_max };
+    for (int t : T) {
+      int code = 16 * (t + 40);
+      if (code >= 0 && code < 4096) bSample[code] = true;
+    }
+  }
+
+  for (int code = 0; code < 4096; code++) {
+    uint32_t rgb = color.rgb(code);
+    const int actual[3] = { (int) (rgb >> 16) & 0xFF, (int) (rgb >> 8) & 0xFF, (int) rgb & 0xFF };
+    double expected[3];
+    reference(code, expected);
+
+    bool bSame = (rgb >> 24) == 0;
+    for (int c = 0; c < 3; c++) {
+      if (fabs(actual[c] - expected[c]) > 1) bSame = false;
+    }
+    if (!bSame) {
+      if (failures < 10) {
+	fprintf(stderr, "mlxcolors: code %d (%.4f degC): %d,%d,%d, expected %.2f,%.2f,%.2f\n", code, code / 16.0 - 40,
+		actual[0], actual[1], actual[2], expected[0], expected[1], expected[2]);
+      }
+      ++failures;
+    }
+    if (bSample[code]) {
+      printf("mlxcolors: %4d %8.4f degC: %3d %3d %3d (colors.py %6.2f %6.2f %6.2f)\n", code, code / 16.0 - 40,
+	     actual[0], actual[1], actual[2], expected[0], expected[1], expected[2]);
+    }
+    if (dump) {
+      fprintf(dump, "%d,%.4f,%d,%d,%d\n", code, code / 16.0 - 40, actual[0], actual[1], actual[2]);
+    }
+  }
+  return failures;
+}
+
+static int check_render(const MLXColor &color, const uint16_t *codes, const char *name) { // returns the number of failures
+  static uint8_t  rgb888[128 * 96 * 3];
+  static uint16_t rgb565[128 * 96];
+  int failures = 0;
+
+  for (int scale = 1; scale <= 4; scale <<= 1) {
+    if (!color.render(codes, scale, MLX90640_RGB888, rgb888) || !color.render(codes, scale, MLX90640_RGB565, rgb565)) {
+      fprintf(stderr, "mlxcolors: %s: render at %dx failed\n", name, scale);
+      return 1;
+    }
+    const int width = 32 * scale;
+
+    for (int Y = 0; Y < 24 * scale; Y++) {
+      for (int X = 0; X < width; X++) {
+	/* Sample the input at (X/scale, Y/scale), holding the last column and row.
+	 */
+	double x = (double) X / scale;
+	double y = (double) Y / scale;
+	int x0 = (int) x;
+	int y0 = (int) y;
+	int x1 = (x0 < 31) ? (x0 + 1) : x0;
+	int y1 = (y0 < 23) ? (y0 + 1) : y0;
+	double fx = x - x0;
+	double fy = y - y0;
+	double value = (1 - fx) * (1 - fy) * codes[32 * y0 + x0] + fx * (1 - fy) * codes[32 * y0 + x1]
+	  + (1 - fx) * fy * codes[32 * y1 + x0] + fx * fy * codes[32 * y1 + x1];
+	uint32_t rgb = color.rgb((uint16_t) floor(value + 0.5));
+
+	int index = Y * width + X;
+	uint32_t got = (uint32_t) rgb888[3 * index] << 16 | (uint32_t) rgb888[3 * index + 1] << 8 | rgb888[3 * index + 2];
+	uint16_t packed = ((rgb >> 8) & 0xF800) | ((rgb >> 5) & 0x07E0) | ((rgb >> 3) & 0x001F);
+
+	if (got != rgb || rgb565[index] != packed) {
+	  if (failures < 10) {
+	    fprintf(stderr, "mlxcolors: %s: %dx pixel (%d, %d): %06x / %04x, expected code %.3f: %06x / %04x\n", name, scale,
+		    X, Y, (unsigned) got, (unsigned) rgb565[index], value, (unsigned) rgb, (unsigned) packed);
+	  }
+	  ++failures;
+	}
+      }
+    }
+  }
+  return failures;
+}
+
+static void usage() {
+  fprintf(stderr, "usage: mlxcolors [--colors FILE] [--dump FILE] [--frames N] [--seed S]\n");
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  const char *colors_name = "test/colors.py";
+  const char *dump_name = 0;
+  size_t frames = 200;
+  uint32_t seed = 1;
+
+  for (int a = 1; a < argc; a++) {
+    if (!strcmp(argv[a], "--colors") && a + 1 < argc) {
+      colors_name = argv[++a];
+    } else if (!strcmp(argv[a], "--dump") && a + 1 < argc) {
+      dump_name = argv[++a];
+    } else if (!strcmp(argv[a], "--frames") && a + 1 < argc) {
+      frames = strtoul(argv[++a], 0, 10);
+    } else if (!strcmp(argv[a], "--seed") && a + 1 < argc) {
+      seed = strtoul(argv[++a], 0, 10);
+    } else {
+      usage();
+    }
+  }
+  if (!read_ranges(colors_name)) {
+    return 1;
+  }
+  FILE *dump = dump_name ? fopen(dump_name, "w") : 0;
+  if (dump_name && !dump) {
+    fprintf(stderr, "mlxcolors: unable to open %s\n", dump_name);
+    return 1;
+  }
+
+  static MLXColor color;
+  int table_failures = check_table(color, dump);
+  if (dump) fclose(dump);
+
+  static uint16_t codes[768];
+  static uint16_t pixels[128 * 96];
+  int render_failures = 0;
+
+  for (int p = 0; p < 768; p++) { // the whole table, across the frame
+    codes[p] = (p * 4095) / 767;
+  }
+  render_failures += check_render(color, codes, "gradient");
+
+  for (int p = 0; p < 768; p++) { // extremes side by side
+    codes[p] = (((p / 32) ^ p) & 1) ? 4095 : 0;
+  }
+  render_failures += check_render(color, codes, "chessboard");
+
+  uint32_t state = seed ? seed : 1;
+  for (size_t f = 0; f < frames; f++) {
+    uint16_t base = mlx_test_random(state) % 4096;
+    uint16_t spread = 1 + mlx_test_random(state) % 4096;
+    for (int p = 0; p < 768; p++) {
+      int code = base + (int) (mlx_test_random(state) % spread) - spread / 2;
+      codes[p] = (code < 0) ? 0 : ((code > 4095) ? 4095 : code);
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "frame %lu", (unsigned long) f);
+    render_failures += check_render(color, codes, name);
+  }
+
+  if (color.render(codes, 3, MLX90640_RGB565, pixels)) {
+    fprintf(stderr, "mlxcolors: render at 3x succeeded\n");
+    ++render_failures;
+  }
+
+  printf("mlxcolors: %d colour ranges from %s; %d of 4096 table entries and %d rendered pixels differ\n",
+	 s_count, colors_name, table_failures, render_failures);
+
+  return (table_failures || render_failures) ? 1 : 0;
+}
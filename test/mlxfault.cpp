@@ -0,0 +1,171 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* mlxfault: throughput of MLX::cycle() on a simulated bus with injected I2C errors.
+ *
+ * Build, from the repository root:
+ *   g++ -std=c++17 -O2 -I test/host -I . -o mlxfault test/mlxfault.cpp \
+ *       test/host/MLXSim.cpp test/host/MLXSynth.cpp test/host/MLXTestData.cpp ClassMLX.cpp MLXCalc.cpp
+ *
+ * Usage:
+ *   mlxfault [--hz 0.5..64] [--seconds S] [--error-rate P] [--stuck P] [--target F] [--poll US]
+ *
+ * The simulated sensor publishes a subpage every period for S seconds of virtual time
+ * (default 60) while MLX::cycle() is called every US microseconds (default 1000, as in
+ * ircamlx). The run is made twice: first without errors, for the baseline, then with each
+ * transfer failing with probability P (default 0.001), a failure hanging the bus until it
+ * is reset with probability --stuck (default 0.01). Reported: the subpages calculated in
+ * each run, retries, abandoned subpages, bus resets and the worst recovery time. The exit
+ * status is 1 if the throughput with errors is below the target fraction (default 0.95) of
+ * the baseline, if the worst recovery exceeds the bound in ClassMLX.hh, or if any subpage
+ * not flagged torn (or unchecked) was calculated from anything other than the published data.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ClassMLX.hh"
+#include "MLXSim.hh"
+#include "MLXTestData.hh"
+
+static void usage() {
+  fprintf(stderr, "usage: mlxfault [--hz 0.5..64] [--seconds S] [--error-rate P] [--stuck P] [--target F] [--poll US]\n");
+  exit(2);
+}
+
+struct Result {
+  size_t published;
+  size_t calculated;
+  size_t corrupt; // calculated, not flagged torn or unchecked, but not what was published
+  size_t injected;
+  mlx_FrameStats stats;
+};
+
+static const char *mlx_rate_description(mlx_RefreshRate rate) {
+  static const char *description[] = { "0.5 Hz", "1 Hz", "2 Hz", "4 Hz", "8 Hz", "16 Hz", "32 Hz", "64 Hz" };
+  return description[rate];
+}
+
+static void run(const uint16_t *eeprom, mlx_RefreshRate rate, double seconds, double error_rate, double stuck, uint32_t poll, Result &R) {
+  MLXSimBus bus(eeprom);
+  MLX cam(bus);
+  cam.begin();
+  cam.set_refresh_rate(rate);
+  cam.cycle_mode(true);
+
+  const mlx_Parameters &params = cam.get_parameters();
+
+  static uint16_t raw[2][832]; // published data, alternating subpages
+  for (int s = 0; s < 2; s++) {
+    mlx_test_raw(&params, raw[s], cam.get_resolution(), 25, 3.3f, s + 1);
+  }
+  bus.set_error_rate(error_rate, stuck, 12345);
+  cam.reset_stats();
+
+  const uint32_t period = 2000000UL >> rate;
+  const uint32_t end = host_clock() + (uint32_t) (seconds * 1e6);
+
+  uint32_t next = host_clock() + period;
+  uint16_t subpage = 0;
+
+  R.published = 0;
+  R.calculated = 0;
+  R.corrupt = 0;
+
+  while (host_clock() < end) {
+    if (host_clock() >= next) {
+      bus.publish(raw[subpage], subpage);
+      ++R.published;
+      subpage ^= 1;
+      next += period;
+    }
+    if (cam.cycle()) {
+      ++R.calculated;
+      if (!(cam.get_frame_flags() & (MLX90640_FRAME_TORN | MLX90640_FRAME_UNCHECKED)) && memcmp(cam.get_raw(), raw[cam.get_subpage()], sizeof(raw[0]))) {
+	++R.corrupt;
+      }
+    }
+    host_clock_advance(poll);
+  }
+  R.injected = bus.injected();
+  R.stats = cam.get_stats();
+}
+
+int main(int argc, char **argv) {
+  mlx_RefreshRate rate = MLX90640_16_HZ;
+  double seconds = 60;
+  double error_rate = 0.001;
+  double stuck = 0.01;
+  double target = 0.95;
+  uint32_t poll = 1000;
+
+  for (int a = 1; a < argc; a++) {
+    if (!strcmp(argv[a], "--hz") && a + 1 < argc) {
+      double hz = atof(argv[++a]);
+      int r = 0;
+      while (r < 7 && (0.5 * (1 << r)) < hz) ++r;
+      rate = static_cast<mlx_RefreshRate>(r);
+    } else if (!strcmp(argv[a], "--seconds") && a + 1 < argc) {
+      seconds = atof(argv[++a]);
+    } else if (!strcmp(argv[a], "--error-rate") && a + 1 < argc) {
+      error_rate = atof(argv[++a]);
+    } else if (!strcmp(argv[a], "--stuck") && a + 1 < argc) {
+      stuck = atof(argv[++a]);
+    } else if (!strcmp(argv[a], "--target") && a + 1 < argc) {
+      target = atof(argv[++a]);
+    } else if (!strcmp(argv[a], "--poll") && a + 1 < argc) {
+      poll = strtoul(argv[++a], 0, 10);
+    } else {
+      usage();
+    }
+  }
+  if (!poll) poll = 1;
+
+  uint16_t eeprom[832];
+  mlx_test_eeprom(eeprom, 1, true);
+
+  Result base;
+  Result R;
+  run(eeprom, rate, seconds, 0, 0, poll, base);
+  run(eeprom, rate, seconds, error_rate, stuck, poll, R);
+
+  double fraction = base.calculated ? (double) R.calculated / base.calculated : 0;
+
+  uint32_t bound = MLX90640_ROW_RETRIES * (poll + 1000); // one retry per call, each with a row read of well under 1 ms
+
+  printf("mlxfault: %s, error rate %g (stuck %g): %lu of %lu subpages calculated, %lu without errors (%.4f)\n",
+	 mlx_rate_description(rate), error_rate, stuck, (unsigned long) R.calculated,
+	 (unsigned long) R.published, (unsigned long) base.calculated, fraction);
+  printf("mlxfault: %lu errors (%lu injected), %lu retries, %lu abandoned, %lu resets, %lu torn; worst recovery %lu us; %lu corrupt\n",
+	 (unsigned long) R.stats.errors, (unsigned long) R.injected, (unsigned long) R.stats.retries,
+	 (unsigned long) R.stats.aborted, (unsigned long) R.stats.resets, (unsigned long) R.stats.torn,
+	 (unsigned long) R.stats.recovery_max, (unsigned long) (R.corrupt + base.corrupt));
+
+  bool bFail = false;
+  if (fraction < target) {
+    printf("mlxfault: below the target of %.4f\n", target);
+    bFail = true;
+  }
+  if (R.stats.recovery_max > bound) {
+    printf("mlxfault: recovery exceeds %lu us\n", (unsigned long) bound);
+    bFail = true;
+  }
+  if (R.corrupt || base.corrupt) {
+    printf("mlxfault: subpages were calculated from corrupt data\n");
+    bFail = true;
+  }
+  return bFail ? 1 : 0;
+}
@@ -0,0 +1,88 @@
+import sys
+import ctypes
+import argparse
+
+# ctypes binding for the C++ parser of the IRCam serial protocol (test/host/MLXIngest.h).
+# Build the library first, from the repository root:
+#   g++ -std=c++17 -O2 -shared -fPIC -o libmlxingest.so test/host/MLXIngest.cpp
+
+class IngestStats(ctypes.Structure):
+    _fields_ = [('bytes',    ctypes.c_uint64),
+                ('rows',     ctypes.c_uint64),
+                ('frames',   ctypes.c_uint64),
+                ('dropped',  ctypes.c_uint64),
+                ('resyncs',  ctypes.c_uint64),
+                ('overflow', ctypes.c_uint64)]
+
+class Ingest:
+    def __init__(self, library='./libmlxingest.so'):
+        lib = ctypes.CDLL(library)
+        lib.mlx_ingest_new.restype = ctypes.c_void_p
+        lib.mlx_ingest_free.argtypes = [ctypes.c_void_p]
+        lib.mlx_ingest_reset.argtypes = [ctypes.c_void_p]
+        lib.mlx_ingest_feed.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t]
+        lib.mlx_ingest_feed.restype = ctypes.c_size_t
+        lib.mlx_ingest_frame.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_float), ctypes.POINTER(ctypes.c_uint16), ctypes.POINTER(ctypes.c_uint32)]
+        lib.mlx_ingest_frame.restype = ctypes.c_int
+        lib.mlx_ingest_get_stats.argtypes = [ctypes.c_void_p, ctypes.POINTER(IngestStats)]
+        self.lib = lib
+        self.handle = lib.mlx_ingest_new()
+        self.T = (ctypes.c_float * 768)()
+        self.sequence = ctypes.c_uint32(0)
+
+    def __del__(self):
+        if self.handle:
+            self.lib.mlx_ingest_free(self.handle)
+            self.handle = None
+
+    def feed(self, data):
+        # bytes as read from the serial port, any amount; returns the number of frames waiting
+        return self.lib.mlx_ingest_feed(self.handle, data, len(data))
+
+    def frames(self):
+        # yields (sequence, temperatures) for each waiting frame; temperatures is a list of 768 floats, row by row
+        while self.lib.mlx_ingest_frame(self.handle, self.T, None, ctypes.byref(self.sequence)):
+            yield self.sequence.value, list(self.T)
+
+    def stats(self):
+        s = IngestStats()
+        self.lib.mlx_ingest_get_stats(self.handle, ctypes.byref(s))
+        return s
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description="Decode IRCam serial output with the C++ parser")
+
+    parser.add_argument('--library', help='Path to libmlxingest.so.',              default='./libmlxingest.so', type=str)
+    parser.add_argument('--device',  help='Serial device; otherwise read a capture file.', default='', type=str)
+    parser.add_argument('--file',    help='Captured serial output to decode.',      default='', type=str)
+
+    args = parser.parse_args()
+
+    ingest = Ingest(args.library)
+
+    if len(args.device) > 0:
+        import serial
+        source = serial.Serial(args.device)
+        source.write(b';auto on;')
+        read = lambda: source.read(max(1, source.in_waiting))
+    elif len(args.file) > 0:
+        source = open(args.file, 'rb')
+        read = lambda: source.read(65536)
+    else:
+        print("mlxingest: please specify either --device or --file")
+        sys.exit(2)
+
+    last = None
+    while True:
+        data = read()
+        if not data:
+            break
+        ingest.feed(data)
+        for sequence, T in ingest.frames():
+            if last is not None and sequence != last + 1:
+                print("mlxingest: {n} frame(s) damaged or cut short".format(n=sequence - last - 1))
+            last = sequence
+            print("frame {s}: min={n:.2f} max={x:.2f}".format(s=sequence, n=min(T), x=max(T)))
+
+    s = ingest.stats()
+    print("mlxingest: {b} bytes, {f} frames, {d} dropped, {r} resyncs".format(b=s.bytes, f=s.frames, d=s.dropped, r=s.resyncs))
@@ -0,0 +1,157 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* mlxingestbench: throughput and correctness of the serial-protocol parser (MLXIngest).
+ *
+ * Build, from the repository root:
+ *   g++ -std=c++17 -O2 -I test/host -I . -o mlxingestbench test/mlxingestbench.cpp \
+ *       test/host/MLXIngest.cpp MLXEncode.cpp MLXPacket.cpp
+ *
+ * Usage:
+ *   mlxingestbench [--frames N] [--corrupt RATE] [--chunk BYTES]
+ *
+ * A stream of N frames is encoded as the teensy sends it (MLXEncode), with shell replies
+ * and alarm events mixed in, and a fraction RATE of its bytes overwritten at random. The
+ * stream is fed to the parser in pieces of 1..BYTES bytes (default 4096). Every delivered
+ * frame is checked against the one encoded with that sequence number, and the throughput
+ * is reported. The exit status is 1 if any delivered frame is wrong, or, with no
+ * corruption, if any frame is lost.
+ */
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MLXEncode.hh"
+#include "MLXIngest.h"
+
+static void usage() {
+  fprintf(stderr, "usage: mlxingestbench [--frames N] [--corrupt RATE] [--chunk BYTES]\n");
+  exit(2);
+}
+
+static uint32_t s_seed = 12345;
+
+static uint32_t next_random() { // xorshift32
+  s_seed ^= s_seed << 13;
+  s_seed ^= s_seed >> 17;
+  s_seed ^= s_seed << 5;
+  return s_seed;
+}
+
+int main(int argc, char **argv) {
+  size_t frames = 20000;
+  double corrupt = 0;
+  size_t chunk = 4096;
+
+  for (int a = 1; a < argc; a++) {
+    if (!strcmp(argv[a], "--frames") && a + 1 < argc) {
+      frames = strtoul(argv[++a], 0, 10);
+    } else if (!strcmp(argv[a], "--corrupt") && a + 1 < argc) {
+      corrupt = atof(argv[++a]);
+    } else if (!strcmp(argv[a], "--chunk") && a + 1 < argc) {
+      chunk = strtoul(argv[++a], 0, 10);
+    } else {
+      usage();
+    }
+  }
+  if (!frames || !chunk) usage();
+
+  const int distinct = 64; // frames cycle through this many temperature fields
+  std::vector<std::vector<uint16_t>> expected(distinct, std::vector<uint16_t>(768));
+
+  std::string stream;
+  stream.reserve(frames * (mlx_EncodedFrameLength + 24 * 2 + 64));
+
+  char text[mlx_EncodedFrameLength];
+  float T[768];
+
+  for (size_t f = 0; f < frames; f++) {
+    std::vector<uint16_t> &E = expected[f % distinct];
+    if (f < distinct) {
+      for (int p = 0; p < 768; p++) {
+	T[p] = -40 + (next_random() % 4096) / 16.0f;
+	E[p] = mlx_encode_temperature(T[p]);
+      }
+    } else {
+      for (int p = 0; p < 768; p++) {
+	T[p] = E[p] / 16.0f - 40;
+      }
+    }
+    mlx_encode_frame(T, text);
+
+    for (int row = 0; row < 24; row++) {
+      stream.append(text + row * mlx_EncodedRowLength, mlx_EncodedRowLength);
+      stream.append("\r\n");
+    }
+    if (f % 10 == 0) {
+      stream.append("{!1,+,41.5,3,4,123456};\r\n");
+      stream.append("IRCam: frames=1000 torn=0 dropped=0 missed=0\r\n");
+    }
+  }
+
+  size_t corrupted = (size_t) (corrupt * stream.size());
+  for (size_t c = 0; c < corrupted; c++) {
+    stream[next_random() % stream.size()] = (char) (next_random() & 0x7F);
+  }
+
+  mlx_ingest *ingest = mlx_ingest_new();
+
+  size_t delivered = 0;
+  size_t wrong = 0;
+  uint32_t sequence;
+  static uint16_t codes[768];
+
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(stream.data());
+  size_t remaining = stream.size();
+
+  auto t0 = std::chrono::steady_clock::now();
+
+  while (remaining) {
+    size_t length = 1 + next_random() % chunk;
+    if (length > remaining) length = remaining;
+
+    mlx_ingest_feed(ingest, data, length);
+    data += length;
+    remaining -= length;
+
+    while (mlx_ingest_frame(ingest, 0, codes, &sequence)) {
+      ++delivered;
+      if (!sequence || memcmp(codes, expected[(sequence - 1) % distinct].data(), sizeof(codes))) {
+	++wrong; // with corruption, a damaged digit can still be a valid digit
+      }
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  mlx_ingest_stats stats;
+  mlx_ingest_get_stats(ingest, &stats);
+  mlx_ingest_free(ingest);
+
+  fprintf(stderr, "mlxingestbench: %lu bytes in %.3f s: %.0f MB/s, %.0f frames/s\n",
+	  (unsigned long) stream.size(), seconds, stream.size() / seconds / 1e6, delivered / seconds);
+  fprintf(stderr, "mlxingestbench: %lu of %lu frames delivered (%lu dropped, %lu resyncs, %lu overflow), %lu wrong\n",
+	  (unsigned long) delivered, (unsigned long) frames, (unsigned long) stats.dropped,
+	  (unsigned long) stats.resyncs, (unsigned long) stats.overflow, (unsigned long) wrong);
+
+  if (corrupted) {
+    return 0; // wrong frames are expected: the protocol has no checksum
+  }
+  return (wrong || delivered != frames) ? 1 : 0;
+}
@@ -0,0 +1,202 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* mlxreplay: feed a raw-frame log (see MLXRecord.hh) through MLX on a simulated sensor,
+ * i.e., through exactly the same calculate_temperatures() as on the teensy.
+ *
+ * Build, from the repository root:
+ *   g++ -std=c++17 -O2 -I test/host -I . -o mlxreplay test/mlxreplay.cpp \
+ *       test/host/MLXLog.cpp test/host/MLXShm.cpp test/host/MLXSim.cpp ClassMLX.cpp MLXCalc.cpp
+ *
+ * Options:
+ *   --csv FILE      write temperatures as CSV, one line per row (as logged by ircam.py)
+ *   --f32 FILE      write temperatures as raw float32, 768 per frame
+ *   --compare FILE  compare, bit for bit, with an earlier --f32 output
+ *   --shm NAME      publish each frame to a shared-memory ring (see MLXShm.hh), e.g., /mlx
+ *   --slots N       ... of N slots (16)
+ *   --realtime      replay at the pace of the log's timestamps rather than flat out
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ClassMLX.hh"
+#include "MLXLog.hh"
+#include "MLXShm.hh"
+#include "MLXSim.hh"
+
+static void usage() {
+  fprintf(stderr, "usage: mlxreplay LOG [--csv FILE] [--f32 FILE] [--compare FILE] [--shm NAME [--slots N]] [--realtime]\n");
+  exit(2);
+}
+
+static void sync_control(MLX &cam, MLXSimBus &bus, uint16_t control) {
+  if (bus.get_control() != control) {
+    bus.set_control(control);
+    cam.set_mode(cam.get_mode()); // refresh the values MLX keeps
+    cam.set_refresh_rate(cam.get_refresh_rate());
+    cam.set_resolution(cam.get_resolution());
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *log_name = 0;
+  const char *csv_name = 0;
+  const char *f32_name = 0;
+  const char *cmp_name = 0;
+  const char *shm_name = 0;
+  uint32_t slots = mlx_ShmSlots;
+  bool bRealtime = false;
+
+  for (int a = 1; a < argc; a++) {
+    if (!strcmp(argv[a], "--csv") && a + 1 < argc) {
+      csv_name = argv[++a];
+    } else if (!strcmp(argv[a], "--f32") && a + 1 < argc) {
+      f32_name = argv[++a];
+    } else if (!strcmp(argv[a], "--compare") && a + 1 < argc) {
+      cmp_name = argv[++a];
+    } else if (!strcmp(argv[a], "--shm") && a + 1 < argc) {
+      shm_name = argv[++a];
+    } else if (!strcmp(argv[a], "--slots") && a + 1 < argc) {
+      slots = strtoul(argv[++a], 0, 10);
+    } else if (!strcmp(argv[a], "--realtime")) {
+      bRealtime = true;
+    } else if (argv[a][0] != '-' && !log_name) {
+      log_name = argv[a];
+    } else {
+      usage();
+    }
+  }
+  if (!log_name) usage();
+
+  MLXLog log;
+  if (!log.open(log_name)) {
+    return 1;
+  }
+
+  FILE *csv = csv_name ? fopen(csv_name, "w") : 0;
+  FILE *f32 = f32_name ? fopen(f32_name, "wb") : 0;
+  FILE *cmp = cmp_name ? fopen(cmp_name, "rb") : 0;
+
+  if ((csv_name && !csv) || (f32_name && !f32) || (cmp_name && !cmp)) {
+    fprintf(stderr, "mlxreplay: unable to open output or comparison file\n");
+    return 1;
+  }
+
+  const mlx_RecordHeader &header = log.header();
+
+  MLXSimBus bus(header.eeprom, header.address);
+  if (log.count()) {
+    bus.set_control(log.frame(0).control);
+  }
+
+  MLX cam(bus, header.address);
+  cam.begin();
+  cam.cycle_mode(true);
+
+  MLXShmWriter ring;
+  if (shm_name) {
+    mlx_RecordHeader record;
+    cam.record_header(record);
+    if (!ring.create(shm_name, record, cam.get_parameters(), slots)) {
+      return 1;
+    }
+  }
+  struct timespec t0;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  uint32_t start = log.count() ? log.frame(0).timestamp : 0;
+
+  size_t mismatched = 0;
+  size_t compared = 0;
+
+  for (size_t f = 0; f < log.count(); f++) {
+    const mlx_RecordFrame &frame = log.frame(f);
+
+    if (bRealtime) { // sleep until the frame is due
+      uint64_t due = (uint64_t) t0.tv_sec * 1000000000ULL + t0.tv_nsec + (uint64_t) (uint32_t) (frame.timestamp - start) * 1000ULL;
+      struct timespec ts;
+      ts.tv_sec  = due / 1000000000ULL;
+      ts.tv_nsec = due % 1000000000ULL;
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0);
+    }
+    if (host_clock() < frame.timestamp) {
+      host_clock_set(frame.timestamp);
+    }
+    sync_control(cam, bus, frame.control);
+
+    bus.publish(frame.raw, frame.subpage);
+
+    int calls = 0;
+    while (!cam.cycle()) {
+      if (++calls == 1000) {
+	fprintf(stderr, "mlxreplay: frame %lu: no result from MLX::cycle()\n", (unsigned long) f);
+	return 1;
+      }
+    }
+    const float *T = cam.get_frame();
+
+    if (shm_name) {
+      ring.publish(cam);
+    }
+
+    if (csv) {
+      for (int row = 0; row < 24; row++) {
+	fprintf(csv, "%d", row);
+	for (int col = 0; col < 32; col++) {
+	  fprintf(csv, ",%.2f", T[row * 32 + col]);
+	}
+	fputc('\n', csv);
+      }
+    }
+    if (f32) {
+      fwrite(T, sizeof(float), 768, f32);
+    }
+    if (cmp) {
+      float ref[768];
+      if (fread(ref, sizeof(float), 768, cmp) != 768) {
+	fprintf(stderr, "mlxreplay: comparison file ends at frame %lu\n", (unsigned long) f);
+	fclose(cmp);
+	cmp = 0;
+      } else {
+	++compared;
+	if (memcmp(ref, T, sizeof(ref))) {
+	  if (!mismatched) {
+	    fprintf(stderr, "mlxreplay: first mismatch at frame %lu\n", (unsigned long) f);
+	  }
+	  ++mismatched;
+	}
+      }
+    }
+  }
+
+  const mlx_FrameStats &stats = cam.get_stats();
+
+  fprintf(stderr, "mlxreplay: %lu frames (torn %lu, dropped %lu, missed %lu)\n",
+	  (unsigned long) log.count(), (unsigned long) stats.torn,
+	  (unsigned long) stats.dropped, (unsigned long) stats.missed);
+
+  if (cmp_name) {
+    fprintf(stderr, "mlxreplay: %lu of %lu frames differ from %s\n",
+	    (unsigned long) mismatched, (unsigned long) compared, cmp_name);
+  }
+
+  if (csv) fclose(csv);
+  if (f32) fclose(f32);
+  if (cmp) fclose(cmp);
+
+  return mismatched ? 3 : 0;
+}
@@ -0,0 +1,226 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* mlxshmbench: latency and consistency of the shared-memory frame ring (MLXShm.hh), with
+ * reader processes forked from the writer.
+ *
+ * Build, from the repository root:
+ *   g++ -std=c++17 -O2 -I test/host -I . -o mlxshmbench test/mlxshmbench.cpp \
+ *       test/host/MLXShm.cpp test/host/MLXSynth.cpp test/host/MLXTestData.cpp MLXCalc.cpp
+ *
+ * Usage:
+ *   mlxshmbench [--frames N] [--hz RATE] [--readers N] [--slots N] [--name NAME]
+ *
+ * The writer publishes N synthetic frames (20000) at RATE per second (1000; 0 for as fast
+ * as possible) into a ring of --slots slots (16). Each reader follows the ring with next()
+ * and checks every frame it accepts: all of its pixels are set from the frame index, so
+ * a frame that changed while being read shows up as inconsistent. For each reader the
+ * latency from commit() to the frame being seen is reported (min, median, 99th percentile,
+ * max), along with the frames read and the frames lost to overwriting. The exit status is
+ * 1 if any reader accepted an inconsistent frame, or (when paced) read nothing.
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "MLXShm.hh"
+#include "MLXTestData.hh"
+
+struct ReaderResult {
+  uint64_t read;
+  uint64_t lost;
+  uint64_t inconsistent; // accepted by done(), but not all of one frame
+  uint64_t ns_min;
+  uint64_t ns_median;
+  uint64_t ns_p99;
+  uint64_t ns_max;
+};
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static float pixel_value(uint64_t index, int p) {
+  return (float) (index % 4096) + p * (1.0f / 1024);
+}
+
+static void usage() {
+  fprintf(stderr, "usage: mlxshmbench [--frames N] [--hz RATE] [--readers N] [--slots N] [--name NAME]\n");
+  exit(2);
+}
+
+static void reader(const char *name, int ready, int results) {
+  ReaderResult R;
+  memset(&R, 0, sizeof(R));
+
+  MLXShmReader ring;
+  bool bOpen = ring.open(name);
+  char c = bOpen ? 'r' : 'x';
+  if (write(ready, &c, 1) != 1 || !bOpen) {
+    _exit(1);
+  }
+  std::vector<uint64_t> latency;
+
+  while (true) {
+    const mlx_ShmFrame *frame = 0;
+    if (ring.next(frame) != MLX90640_SHM_READY) {
+      if (!ring.closed()) {
+	sched_yield();
+	continue;
+      }
+      if (ring.next(frame) != MLX90640_SHM_READY) break; // closed() follows the last commit()
+    }
+    uint64_t seen = now_ns();
+    uint64_t index = frame->index;
+    uint64_t publish_ns = frame->publish_ns;
+    bool bConsistent = (frame->record.sequence == (uint32_t) index);
+    for (int p = 0; p < 768 && bConsistent; p++) {
+      bConsistent = (frame->T[p] == pixel_value(index, p));
+    }
+    if (ring.done()) {
+      ++R.read;
+      if (!bConsistent) ++R.inconsistent;
+      latency.push_back(seen - publish_ns);
+    }
+  }
+  R.lost = ring.lost();
+
+  if (!latency.empty()) {
+    std::sort(latency.begin(), latency.end());
+    R.ns_min    = latency.front();
+    R.ns_median = latency[latency.size() / 2];
+    R.ns_p99    = latency[(latency.size() * 99) / 100];
+    R.ns_max    = latency.back();
+  }
+  if (write(results, &R, sizeof(R)) != sizeof(R)) {
+    _exit(1);
+  }
+  _exit(0);
+}
+
+int main(int argc, char **argv) {
+  uint64_t frames = 20000;
+  double hz = 1000;
+  int readers = 2;
+  uint32_t slots = mlx_ShmSlots;
+  const char *name = "/mlxshmbench";
+
+  for (int a = 1; a < argc; a++) {
+    if (!strcmp(argv[a], "--frames") && a + 1 < argc) {
+      frames = strtoull(argv[++a], 0, 10);
+    } else if (!strcmp(argv[a], "--hz") && a + 1 < argc) {
+      hz = atof(argv[++a]);
+    } else if (!strcmp(argv[a], "--readers") && a + 1 < argc) {
+      readers = atoi(argv[++a]);
+    } else if (!strcmp(argv[a], "--slots") && a + 1 < argc) {
+      slots = strtoul(argv[++a], 0, 10);
+    } else if (!strcmp(argv[a], "--name") && a + 1 < argc) {
+      name = argv[++a];
+    } else {
+      usage();
+    }
+  }
+  if (readers < 1) readers = 1;
+
+  mlx_RecordHeader record;
+  memset(&record, 0, sizeof(record));
+  mlx_test_eeprom(record.eeprom, 1, true);
+
+  mlx_Parameters params;
+  float scratch[768];
+  mlx_extract_parameters(record.eeprom, &params, scratch);
+
+  MLXShmWriter ring;
+  if (!ring.create(name, record, params, slots)) {
+    return 1;
+  }
+
+  int ready[2];
+  int results[2];
+  if (pipe(ready) || pipe(results)) {
+    fprintf(stderr, "mlxshmbench: unable to create pipes\n");
+    return 1;
+  }
+  for (int r = 0; r < readers; r++) {
+    if (!fork()) {
+      reader(name, ready[1], results[1]);
+    }
+  }
+  for (int r = 0; r < readers; r++) { // wait until every reader has the ring mapped
+    char c = 0;
+    if (read(ready[0], &c, 1) != 1 || c != 'r') {
+      fprintf(stderr, "mlxshmbench: a reader failed to start\n");
+      return 1;
+    }
+  }
+
+  uint64_t period = (hz > 0) ? (uint64_t) (1e9 / hz) : 0;
+  uint64_t next = now_ns();
+  uint64_t t0 = next;
+
+  for (uint64_t f = 0; f < frames; f++) {
+    if (period) {
+      next += period;
+      struct timespec ts;
+      ts.tv_sec  = next / 1000000000ULL;
+      ts.tv_nsec = next % 1000000000ULL;
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0);
+    }
+    mlx_ShmFrame &frame = ring.begin();
+    memset(&frame.record, 0, sizeof(frame.record));
+    frame.record.sequence = (uint32_t) f;
+    frame.ambient = 25;
+    frame.vdd = 3.3f;
+    for (int p = 0; p < 768; p++) {
+      frame.T[p] = pixel_value(f, p);
+    }
+    ring.commit();
+  }
+  double seconds = (now_ns() - t0) * 1e-9;
+  ring.close();
+
+  bool bFailed = false;
+
+  fprintf(stderr, "mlxshmbench: %lu frames in %.3f s (%.0f/s), %u slots of %lu bytes\n",
+	  (unsigned long) frames, seconds, frames / seconds, slots, (unsigned long) sizeof(mlx_ShmSlot));
+
+  for (int r = 0; r < readers; r++) {
+    ReaderResult R;
+    if (read(results[0], &R, sizeof(R)) != sizeof(R)) {
+      fprintf(stderr, "mlxshmbench: a reader failed\n");
+      bFailed = true;
+      continue;
+    }
+    fprintf(stderr, "mlxshmbench: reader %d: %lu read, %lu lost, %lu inconsistent; latency min %.1f us, median %.1f us, 99%% %.1f us, max %.1f us\n",
+	    r, (unsigned long) R.read, (unsigned long) R.lost, (unsigned long) R.inconsistent,
+	    R.ns_min * 1e-3, R.ns_median * 1e-3, R.ns_p99 * 1e-3, R.ns_max * 1e-3);
+    if (R.inconsistent || (period && !R.read)) {
+      bFailed = true;
+    }
+  }
+  while (wait(0) > 0);
+
+  return bFailed ? 1 : 0;
+}
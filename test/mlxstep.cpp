@@ -0,0 +1,234 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* mlxstep: triggered single-shot (step mode) capture on a simulated sensor.
+ *
+ * Build, from the repository root:
+ *   g++ -std=c++17 -O2 -I test/host -I . -o mlxstep test/mlxstep.cpp \
+ *       test/host/MLXSim.cpp test/host/MLXSynth.cpp test/host/MLXTestData.cpp ClassMLX.cpp MLXCalc.cpp
+ *
+ * Usage:
+ *   mlxstep [--hz 0.5..64] [--captures N] [--poll US]
+ *
+ * The simulated sensor, in step mode, measures only while MLXSimBus::measuring(), and
+ * publishes a subpage one period (at the given refresh rate, default 8 Hz) after it starts.
+ * MLX::cycle() is called every US microseconds (default 1000, as in ircamlx). Before each
+ * of the N captures (default 5) the idle sensor is left for a few periods: it must not
+ * measure, and cycle() must not use the bus. Then trigger() must be accepted, and a second
+ * trigger() refused until the frame is ready; the two subpages must be measured
+ * back-to-back, frame_ready() must be set once both are in, get_frame() must be exactly the
+ * two subpages as converted by mlx_calculate_temperatures(), and the capture time
+ * (mlx_Timing::capture) must be under two periods plus two subpage reads and two polls.
+ * If the period is shorter than a subpage read (64 Hz on the simulated bus), the second
+ * subpage overwrites the first while it is read: it must then be flagged torn instead.
+ * The exit status is 1 on any failure.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ClassMLX.hh"
+#include "MLXSim.hh"
+#include "MLXTestData.hh"
+
+static int s_failures = 0;
+
+static void fail(int capture, const char *what) {
+  printf("mlxstep: capture %d: %s\n", capture, what);
+  ++s_failures;
+}
+
+static void usage() {
+  fprintf(stderr, "usage: mlxstep [--hz 0.5..64] [--captures N] [--poll US]\n");
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  mlx_RefreshRate rate = MLX90640_8_HZ;
+  int captures = 5;
+  uint32_t poll = 1000;
+
+  for (int a = 1; a < argc; a++) {
+    if (!strcmp(argv[a], "--hz") && a + 1 < argc) {
+      double hz = atof(argv[++a]);
+      int r = 0;
+      while (r < 7 && (0.5 * (1 << r)) < hz) ++r;
+      rate = static_cast<mlx_RefreshRate>(r);
+    } else if (!strcmp(argv[a], "--captures") && a + 1 < argc) {
+      captures = atoi(argv[++a]);
+    } else if (!strcmp(argv[a], "--poll") && a + 1 < argc) {
+      poll = strtoul(argv[++a], 0, 10);
+    } else {
+      usage();
+    }
+  }
+  if (!poll) poll = 1;
+
+  uint16_t eeprom[832];
+  mlx_test_eeprom(eeprom, 1, true);
+
+  MLXSimBus bus(eeprom);
+  MLX cam(bus);
+  cam.begin();
+  cam.set_refresh_rate(rate);
+  cam.cycle_mode(true);
+
+  if (cam.trigger()) {
+    fail(0, "trigger() accepted when not in step mode");
+  }
+  cam.step_mode(true);
+
+  const mlx_Parameters &params = cam.get_parameters();
+  const mlx_Mode mode = mlx_control_mode(bus.get_control());
+  const mlx_Resolution resolution = mlx_control_resolution(bus.get_control());
+  const uint32_t period = 2000000UL >> rate;
+
+  uint32_t read_max = 0;
+  uint32_t capture_max = 0;
+
+  for (int c = 1; c <= captures; c++) {
+    static uint16_t raw[2][832]; // a new scene for every capture
+    static float expected[768];
+    for (int s = 0; s < 2; s++) {
+      mlx_test_raw(&params, raw[s], resolution, 20 + c, 3.3f, 2 * c + s);
+      mlx_calculate_temperatures(&params, raw[s], mode, resolution, s, expected);
+    }
+
+    /* Idle: nothing is measured, and cycle() leaves the bus alone (transfers would
+     * advance the virtual clock).
+     */
+    for (uint32_t t = 0; t < 3 * period; t += poll) {
+      uint32_t before = host_clock();
+      if (cam.cycle() || host_clock() != before) {
+	fail(c, "cycle() used the bus while idle");
+	break;
+      }
+      if (bus.measuring()) {
+	fail(c, "the sensor measured while idle");
+	break;
+      }
+      host_clock_advance(poll);
+    }
+    if (cam.frame_ready() != (c > 1)) {
+      fail(c, "frame_ready() changed while idle");
+    }
+
+    if (!cam.trigger()) {
+      fail(c, "trigger() refused");
+      continue;
+    }
+    if (cam.frame_ready()) {
+      fail(c, "frame_ready() still set after trigger()");
+    }
+    if (cam.trigger()) {
+      fail(c, "a second trigger() accepted while capturing");
+    }
+
+    const uint32_t start = host_clock();
+    uint32_t due = 0;            // when the subpage being measured will be published
+    bool bMeasuring = false;
+    uint16_t subpage = c & 1;    // the sensor alternates, regardless of captures
+    int published = 0;
+    int calculated = 0;
+    uint8_t subpages = 0;        // bit per subpage calculated
+    bool bTorn = false;          // either subpage flagged torn
+    uint32_t idle = 0;           // time not measuring, between the first publish and the last
+
+    while (!cam.frame_ready() && host_clock() - start < 8 * period + 1000000) {
+      if (bus.measuring() && !bMeasuring) {
+	bMeasuring = true;
+	due = host_clock() + period;
+      }
+      if (bMeasuring && host_clock() >= due) {
+	bus.publish(raw[subpage], subpage);
+	subpage ^= 1;
+	++published;
+	bMeasuring = false;
+      }
+      if (!bMeasuring && published == 1) {
+	idle += poll;
+      }
+      if (cam.cycle()) {
+	++calculated;
+	subpages |= 1 << cam.get_subpage();
+	if (cam.get_frame_flags() & MLX90640_FRAME_TORN) {
+	  bTorn = true;
+	}
+	if (read_max < cam.get_timing().read) {
+	  read_max = cam.get_timing().read;
+	}
+	if (calculated < 2 && cam.frame_ready()) {
+	  fail(c, "frame_ready() set after one subpage");
+	}
+      }
+      if (!cam.frame_ready() && calculated < 2 && cam.trigger()) {
+	fail(c, "trigger() accepted while capturing");
+      }
+      host_clock_advance(poll);
+    }
+
+    uint32_t capture = cam.get_timing().capture;
+    if (capture_max < capture) {
+      capture_max = capture;
+    }
+    if (!cam.frame_ready()) {
+      fail(c, "frame_ready() never set");
+      continue;
+    }
+    if (published != 2 || calculated != 2 || subpages != 3) {
+      char what[96];
+      snprintf(what, sizeof(what), "%d subpages published, %d calculated (mask %u); expected both, once each",
+	       published, calculated, (unsigned) subpages);
+      fail(c, what);
+    }
+    if (idle > 2 * poll) {
+      char what[96];
+      snprintf(what, sizeof(what), "%lu us between the subpages without a measurement", (unsigned long) idle);
+      fail(c, what);
+    }
+    if (bTorn) {
+      if (period > read_max + 2 * poll) {
+	fail(c, "a subpage was torn, though the period is longer than the read");
+      }
+    } else if (memcmp(cam.get_frame(), expected, sizeof(expected))) {
+      fail(c, "get_frame() differs from the two subpages");
+    }
+    uint32_t bound = 2 * period + 2 * read_max + 2 * poll;
+    if (capture < 2 * period || capture > bound) {
+      char what[96];
+      snprintf(what, sizeof(what), "capture took %lu us; expected %lu-%lu", (unsigned long) capture,
+	       (unsigned long) (2 * period), (unsigned long) bound);
+      fail(c, what);
+    }
+
+    /* Once the frame is in, the sensor stops: no third measurement.
+     */
+    for (uint32_t t = 0; t < 2 * period; t += poll) {
+      if (bus.measuring()) {
+	fail(c, "the sensor measured after the frame was complete");
+	break;
+      }
+      cam.cycle();
+      host_clock_advance(poll);
+    }
+  }
+
+  printf("mlxstep: %s, %d captures, poll %lu us: worst capture %.1f ms (two periods %.1f ms, subpage read %.1f ms); %lu torn; %d failures\n",
+	 cam.refresh_rate_description(rate), captures, (unsigned long) poll, capture_max * 1e-3, 2 * period * 1e-3, read_max * 1e-3,
+	 (unsigned long) cam.get_stats().torn, s_failures);
+
+  return s_failures ? 1 : 0;
+}
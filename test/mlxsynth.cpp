@@ -0,0 +1,256 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* mlxsynth: write a raw-frame log (see MLXRecord.hh) synthesized from temperature scenes
+ * (see MLXSynth.hh), for mlxreplay, mlxbatch and the like, with the scenes themselves as
+ * ground truth.
+ *
+ * Build, from the repository root:
+ *   g++ -std=c++17 -O2 -I test/host -I . -o mlxsynth test/mlxsynth.cpp \
+ *       test/host/MLXSynth.cpp test/host/MLXTestData.cpp MLXCalc.cpp
+ *
+ * Usage:
+ *   mlxsynth LOG [options]
+ *
+ * Options:
+ *   --frames N        number of subpages (64)
+ *   --csv FILE        scenes from FILE ("-" for stdin) in the CSV of simcam.py and ircam.py,
+ *                     24 lines of "row,T0,...,T31" per scene; otherwise the expanding wave
+ *                     of simcam.py, sampled at the subpage times
+ *   --flat DEGC       a uniform scene instead
+ *   --hz RATE         subpages per second (4), as for the refresh rate
+ *   --mode chess|interleaved   (chess)
+ *   --resolution BITS 16..19 (18)
+ *   --ta DEGC         ambient temperature (25)
+ *   --vdd V           supply voltage (3.3)
+ *   --gain G          gain drift (1)
+ *   --noise COUNTS    rms pixel noise (0)
+ *   --eeprom SEED     generated EEPROM image (1), calibrated in chess mode unless
+ *   --interleaved-calibration
+ *   --seed S          noise seed (1)
+ *   --truth FILE      write the scenes as raw float32, 768 per subpage
+ *   --tolerance DEGC  without noise, the largest error allowed converting back (0.1)
+ *
+ * Subpages alternate 0, 1, 0, ... and each is converted back with mlx_calculate_temperatures()
+ * and compared with its scene; the error (over the subpage's pixels) and the number of
+ * clipped raw words are reported. Without noise, the exit status is 1 if the maximum error
+ * exceeds the tolerance.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MLXRecord.hh"
+#include "MLXSynth.hh"
+#include "MLXTestData.hh"
+
+static void usage() {
+  fprintf(stderr, "usage: mlxsynth LOG [--frames N] [--csv FILE | --flat DEGC] [--hz RATE] [--mode chess|interleaved]\n"
+	          "                [--resolution BITS] [--ta DEGC] [--vdd V] [--gain G] [--noise COUNTS] [--eeprom SEED]\n"
+	          "                [--interleaved-calibration] [--seed S] [--truth FILE] [--tolerance DEGC]\n");
+  exit(2);
+}
+
+static void wave(float *T, double t) { // as create_wave(t, 0.1) in simcam.py
+  double rmax = sqrt(15.5 * 15.5 + 11.5 * 11.5);
+  double rmin = sqrt(0.5 * 0.5 + 0.5 * 0.5);
+
+  for (int row = 0; row < 24; row++) {
+    for (int col = 0; col < 32; col++) {
+      double x = -15.5 + col;
+      double y = -11.5 + row;
+      double r = sqrt(x * x + y * y);
+      double a = 127 * (rmax - r) / (rmax - rmin);
+      double o =  66 * (rmax - r) / (rmax - rmin) + 22;
+      T[row * 32 + col] = o + a * sin(r - 2 * M_PI * 0.1 * t);
+    }
+  }
+}
+
+static bool read_csv(FILE *csv, float *T) { // one scene; false at the end of the file
+  char line[1024];
+  for (int row = 0; row < 24; row++) {
+    if (!fgets(line, sizeof(line), csv)) return false;
+
+    char *ptr = line;
+    if (strtol(ptr, &ptr, 10) != row) return false;
+    for (int col = 0; col < 32; col++) {
+      if (*ptr++ != ',') return false;
+      T[row * 32 + col] = strtof(ptr, &ptr);
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  const char *log_name = 0;
+  const char *csv_name = 0;
+  const char *truth_name = 0;
+  size_t frames = 64;
+  double hz = 4;
+  double flat = 0;
+  bool bFlat = false;
+  bool bChessCalibrated = true;
+  uint32_t eeprom_seed = 1;
+  uint32_t seed = 1;
+  double tolerance = 0.1;
+
+  mlx_SynthConditions conditions;
+  mlx_synth_defaults(conditions);
+
+  for (int a = 1; a < argc; a++) {
+    if (!strcmp(argv[a], "--frames") && a + 1 < argc) {
+      frames = strtoul(argv[++a], 0, 10);
+    } else if (!strcmp(argv[a], "--csv") && a + 1 < argc) {
+      csv_name = argv[++a];
+    } else if (!strcmp(argv[a], "--flat") && a + 1 < argc) {
+      flat = atof(argv[++a]);
+      bFlat = true;
+    } else if (!strcmp(argv[a], "--hz") && a + 1 < argc) {
+      hz = atof(argv[++a]);
+    } else if (!strcmp(argv[a], "--mode") && a + 1 < argc) {
+      ++a;
+      if (!strcmp(argv[a], "chess")) {
+	conditions.mode = MLX90640_CHESS;
+      } else if (!strcmp(argv[a], "interleaved")) {
+	conditions.mode = MLX90640_INTERLEAVED;
+      } else {
+	usage();
+      }
+    } else if (!strcmp(argv[a], "--resolution") && a + 1 < argc) {
+      int bits = atoi(argv[++a]);
+      if (bits < 16 || bits > 19) usage();
+      conditions.resolution = static_cast<mlx_Resolution>(bits - 16);
+    } else if (!strcmp(argv[a], "--ta") && a + 1 < argc) {
+      conditions.ta = atof(argv[++a]);
+    } else if (!strcmp(argv[a], "--vdd") && a + 1 < argc) {
+      conditions.vdd = atof(argv[++a]);
+    } else if (!strcmp(argv[a], "--gain") && a + 1 < argc) {
+      conditions.gain = atof(argv[++a]);
+    } else if (!strcmp(argv[a], "--noise") && a + 1 < argc) {
+      conditions.noise = atof(argv[++a]);
+    } else if (!strcmp(argv[a], "--eeprom") && a + 1 < argc) {
+      eeprom_seed = strtoul(argv[++a], 0, 10);
+    } else if (!strcmp(argv[a], "--interleaved-calibration")) {
+      bChessCalibrated = false;
+    } else if (!strcmp(argv[a], "--seed") && a + 1 < argc) {
+      seed = strtoul(argv[++a], 0, 10);
+    } else if (!strcmp(argv[a], "--truth") && a + 1 < argc) {
+      truth_name = argv[++a];
+    } else if (!strcmp(argv[a], "--tolerance") && a + 1 < argc) {
+      tolerance = atof(argv[++a]);
+    } else if (argv[a][0] != '-' && !log_name) {
+      log_name = argv[a];
+    } else {
+      usage();
+    }
+  }
+  if (!log_name || (csv_name && bFlat) || !(conditions.gain > 0)) usage();
+
+  int rate = 0; // the refresh rate whose subpage period is nearest 1 / hz, and no slower
+  while (rate < 7 && (0.5 * (1 << rate)) < hz) ++rate;
+  uint32_t period = 2000000UL >> rate;
+
+  FILE *log = fopen(log_name, "wb");
+  FILE *csv = csv_name ? (strcmp(csv_name, "-") ? fopen(csv_name, "r") : stdin) : 0;
+  FILE *truth = truth_name ? fopen(truth_name, "wb") : 0;
+
+  if (!log || (csv_name && !csv) || (truth_name && !truth)) {
+    fprintf(stderr, "mlxsynth: unable to open input or output file\n");
+    return 1;
+  }
+
+  static mlx_RecordHeader header;
+  memcpy(header.magic, mlx_RecordMagic, 4);
+  header.version     = mlx_RecordVersion;
+  header.header_size = sizeof(mlx_RecordHeader);
+  header.frame_size  = sizeof(mlx_RecordFrame);
+  header.address     = 0x33;
+  header.start       = 0;
+  mlx_test_eeprom(header.eeprom, eeprom_seed, bChessCalibrated);
+
+  mlx_Parameters params;
+  float scratch[768];
+  if (mlx_extract_parameters(header.eeprom, &params, scratch)) {
+    fprintf(stderr, "mlxsynth: EEPROM %u has bad pixels\n", eeprom_seed);
+  }
+  fwrite(&header, sizeof(header), 1, log);
+
+  uint16_t control = 0x0001 | (rate << 7) | (conditions.resolution << 10);
+  if (conditions.mode == MLX90640_CHESS) {
+    control |= 0x1000;
+  }
+  uint32_t state = seed ? seed : 1;
+
+  double max_error = 0;
+  double sum_squares = 0;
+  size_t pixels = 0;
+  size_t clipped = 0;
+  size_t written = 0;
+
+  static mlx_RecordFrame frame;
+  float T[768];
+  float result[768];
+
+  for (size_t f = 0; f < frames; f++) {
+    if (csv) {
+      if (!read_csv(csv, T)) break;
+    } else if (bFlat) {
+      for (int p = 0; p < 768; p++) {
+	T[p] = flat;
+      }
+    } else {
+      wave(T, f * period * 1e-6);
+    }
+    frame.timestamp = f * period;
+    frame.sequence  = f;
+    frame.control   = control;
+    frame.subpage   = f & 1;
+    frame.flags     = 0; // MLX90640_FRAME_CLEAN
+    clipped += mlx_synthesize(&params, frame.raw, T, conditions, state);
+
+    fwrite(&frame, sizeof(frame), 1, log);
+    if (truth) {
+      fwrite(T, sizeof(float), 768, truth);
+    }
+    ++written;
+
+    mlx_calculate_temperatures(&params, frame.raw, conditions.mode, conditions.resolution, frame.subpage, result);
+    for (int p = 0; p < 768; p++) {
+      if (mlx_pixel_subpage(p, conditions.mode) != frame.subpage) continue;
+
+      double error = fabs(result[p] - T[p]);
+      if (!(error <= max_error)) { // NaN included
+	max_error = error;
+      }
+      sum_squares += error * error;
+      ++pixels;
+    }
+  }
+
+  fclose(log);
+  if (truth) fclose(truth);
+  if (csv && csv != stdin) fclose(csv);
+
+  fprintf(stderr, "mlxsynth: %lu subpages at %g Hz; converted back: max error %.4f degC, rms %.4f degC; %lu raw words clipped\n",
+	  (unsigned long) written, 1e6 / period, max_error, pixels ? sqrt(sum_squares / pixels) : 0.0, (unsigned long) clipped);
+
+  if (conditions.noise == 0 && !(max_error <= tolerance)) {
+    fprintf(stderr, "mlxsynth: error exceeds the tolerance of %g degC\n", tolerance);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,177 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* mlxtune: MLXTuner on a simulated sensor whose caller is too slow for the refresh rate.
+ *
+ * Build, from the repository root:
+ *   g++ -std=c++17 -O2 -I test/host -I . -o mlxtune test/mlxtune.cpp \
+ *       test/host/MLXSim.cpp test/host/MLXSynth.cpp test/host/MLXTestData.cpp \
+ *       ClassMLX.cpp MLXCalc.cpp MLXTuner.cpp
+ *
+ * Usage:
+ *   mlxtune [--priority rate|noise] [--hz 0.5..64] [--load US] [--seconds S]
+ *
+ * The sensor starts at the given refresh rate (64 Hz) and 16-bit resolution, and publishes
+ * subpages at whatever rate its control register is set to. Each time MLX::cycle() returns
+ * a subpage the caller spends US microseconds of virtual time (default 40000) on it, so
+ * subpages are dropped until the rate comes down. The tuner is run with the given priority,
+ * or else with each in turn. The exit status is 1 unless, each time, the tuner lowers the
+ * refresh rate, raises the resolution to 19 bit, and runs without drops over the last
+ * quarter of the S seconds (default 120); and, with both priorities, unless NOISE settles
+ * at a slower refresh rate than RATE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ClassMLX.hh"
+#include "MLXSim.hh"
+#include "MLXTestData.hh"
+#include "MLXTuner.hh"
+
+static void usage() {
+  fprintf(stderr, "usage: mlxtune [--priority rate|noise] [--hz 0.5..64] [--load US] [--seconds S]\n");
+  exit(2);
+}
+
+struct Result {
+  mlx_RefreshRate rate;
+  mlx_Resolution  resolution;
+  bool            bPass;
+};
+
+static Result run(mlx_TunePriority priority, mlx_RefreshRate rate, uint32_t load, double seconds) {
+  uint16_t eeprom[832];
+  mlx_test_eeprom(eeprom, 1, true);
+
+  MLXSimBus bus(eeprom);
+  MLX cam(bus);
+  cam.begin();
+  cam.set_refresh_rate(rate);
+  cam.set_resolution(MLX90640_ADC_16BIT);
+  cam.cycle_mode(true);
+
+  static uint16_t raw[2][832]; // published data, alternating subpages
+  for (int s = 0; s < 2; s++) {
+    mlx_test_raw(&cam.get_parameters(), raw[s], cam.get_resolution(), 25, 3.3f, s + 1);
+  }
+
+  MLXTuner tuner(cam, priority);
+  tuner.enable(true);
+  cam.reset_stats();
+
+  const uint32_t start = host_clock();
+  const uint32_t end   = start + (uint32_t) (seconds * 1e6);
+  const uint32_t tail  = end - (uint32_t) (seconds * 0.25e6);
+  const char *name = (priority == MLX90640_TUNE_RATE) ? "rate" : "noise";
+
+  uint32_t next = start;
+  uint16_t subpage = 0;
+  uint32_t missed_before_tail = 0;
+  bool bTail = false;
+  size_t changes = 0;
+
+  while (host_clock() < end) {
+    if (!bTail && host_clock() >= tail) {
+      missed_before_tail = cam.get_stats().missed;
+      bTail = true;
+    }
+    if (host_clock() >= next) { // the sensor keeps to whatever rate it is set to
+      bus.publish(raw[subpage], subpage);
+      subpage ^= 1;
+      next += 2000000UL >> mlx_control_refresh_rate(bus.get_control());
+    }
+    if (cam.cycle()) {
+      if (tuner.update()) {
+	++changes;
+	printf("mlxtune: %s: %7.3f s: %s, %s (missed %lu)\n", name, (host_clock() - start) * 1e-6,
+	       cam.refresh_rate_description(cam.cached_refresh_rate()), cam.resolution_description(cam.cached_resolution()),
+	       (unsigned long) cam.get_stats().missed);
+      }
+      host_clock_advance(load); // the caller's work on the subpage
+    }
+    host_clock_advance(1000);
+  }
+
+  const mlx_FrameStats &stats = cam.get_stats();
+  uint32_t tail_missed = stats.missed - missed_before_tail;
+
+  Result result = { cam.cached_refresh_rate(), cam.cached_resolution(), true };
+
+  printf("mlxtune: %s priority, %lu us per subpage: %s -> %s, %s -> %s; %lu changes, %lu subpages missed (%lu in the last quarter)\n",
+	 name, (unsigned long) load,
+	 cam.refresh_rate_description(rate), cam.refresh_rate_description(result.rate),
+	 cam.resolution_description(MLX90640_ADC_16BIT), cam.resolution_description(result.resolution),
+	 (unsigned long) changes, (unsigned long) stats.missed, (unsigned long) tail_missed);
+
+  if (result.rate >= rate) {
+    printf("mlxtune: %s: the refresh rate did not come down\n", name);
+    result.bPass = false;
+  }
+  if (result.resolution != MLX90640_ADC_19BIT) {
+    printf("mlxtune: %s: the resolution did not go up to 19 bit\n", name);
+    result.bPass = false;
+  }
+  if (tail_missed) {
+    printf("mlxtune: %s: still dropping subpages\n", name);
+    result.bPass = false;
+  }
+  return result;
+}
+
+int main(int argc, char **argv) {
+  int priority = -1; // both
+  mlx_RefreshRate rate = MLX90640_64_HZ;
+  uint32_t load = 40000;
+  double seconds = 120;
+
+  for (int a = 1; a < argc; a++) {
+    if (!strcmp(argv[a], "--priority") && a + 1 < argc) {
+      ++a;
+      if (!strcmp(argv[a], "rate")) {
+	priority = MLX90640_TUNE_RATE;
+      } else if (!strcmp(argv[a], "noise")) {
+	priority = MLX90640_TUNE_NOISE;
+      } else {
+	usage();
+      }
+    } else if (!strcmp(argv[a], "--hz") && a + 1 < argc) {
+      double hz = atof(argv[++a]);
+      int r = 0;
+      while (r < 7 && (0.5 * (1 << r)) < hz) ++r;
+      rate = static_cast<mlx_RefreshRate>(r);
+    } else if (!strcmp(argv[a], "--load") && a + 1 < argc) {
+      load = strtoul(argv[++a], 0, 10);
+    } else if (!strcmp(argv[a], "--seconds") && a + 1 < argc) {
+      seconds = atof(argv[++a]);
+    } else {
+      usage();
+    }
+  }
+
+  if (priority >= 0) {
+    return run(static_cast<mlx_TunePriority>(priority), rate, load, seconds).bPass ? 0 : 1;
+  }
+  Result by_rate  = run(MLX90640_TUNE_RATE,  rate, load, seconds);
+  Result by_noise = run(MLX90640_TUNE_NOISE, rate, load, seconds);
+
+  bool bPass = by_rate.bPass && by_noise.bPass;
+  if (by_noise.rate >= by_rate.rate) {
+    printf("mlxtune: noise priority did not settle at a slower refresh rate than rate priority\n");
+    bPass = false;
+  }
+  return bPass ? 0 : 1;
+}
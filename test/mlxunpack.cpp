@@ -0,0 +1,236 @@
+/* -*- mode: c++ -*-
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* mlxunpack: decode the raw passthrough stream of ircamlx (`raw on`; see MLXPacket.hh) and
+ * convert each subpage on the host, with the same mlx_extract_parameters() and
+ * mlx_calculate_temperatures() as MLX uses on the teensy, so the temperatures are exactly
+ * those the teensy would have calculated.
+ *
+ * Build, from the repository root:
+ *   g++ -std=c++17 -O2 -I test/host -I . -o mlxunpack test/mlxunpack.cpp \
+ *       test/host/MLXLog.cpp MLXPacket.cpp MLXCalc.cpp
+ *
+ * Usage:
+ *   mlxunpack STREAM [options]    STREAM is a file or serial device, or "-" for stdin
+ *   mlxunpack --pack LOG STREAM   write the stream ircamlx would send for a raw-frame log
+ *
+ * Options:
+ *   --csv FILE      write temperatures as CSV, one line per row (as logged by ircam.py)
+ *   --f32 FILE      write temperatures as raw float32, 768 per subpage
+ *   --compare FILE  compare, bit for bit, with an --f32 output of mlxreplay
+ *   --log FILE      write the subpages as a raw-frame log (see MLXRecord.hh)
+ *
+ * Anything in the stream between packets (shell responses, say) is skipped. Subpages before
+ * the first calibration packet can't be converted, and are counted but otherwise ignored.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MLXLog.hh"
+#include "MLXPacket.hh"
+
+static void usage() {
+  fprintf(stderr, "usage: mlxunpack STREAM [--csv FILE] [--f32 FILE] [--compare FILE] [--log FILE]\n"
+	          "       mlxunpack --pack LOG STREAM\n");
+  exit(2);
+}
+
+static int pack(const char *log_name, const char *stream_name) {
+  MLXLog log;
+  if (!log.open(log_name)) {
+    return 1;
+  }
+  FILE *stream = fopen(stream_name, "wb");
+  if (!stream) {
+    fprintf(stderr, "mlxunpack: unable to open %s\n", stream_name);
+    return 1;
+  }
+  static uint8_t buffer[mlx_PacketMaxLength];
+  uint32_t last = 0;
+
+  /* As the sketch: a shell response, then the calibration, re-sent once a second.
+   */
+  fputs("IRCam: Raw passthrough on\r\n", stream);
+
+  for (size_t f = 0; f < log.count(); f++) {
+    const mlx_RecordFrame &frame = log.frame(f);
+
+    if (!f || (uint32_t) (frame.timestamp - last) >= 1000000) {
+      last = frame.timestamp;
+      fwrite(buffer, 1, mlx_pack_calibration(log.header(), buffer), stream);
+    }
+    fwrite(buffer, 1, mlx_pack_subpage(frame, buffer), stream);
+  }
+  fclose(stream);
+
+  fprintf(stderr, "mlxunpack: %lu subpages packed\n", (unsigned long) log.count());
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  const char *stream_name = 0;
+  const char *pack_name = 0;
+  const char *csv_name = 0;
+  const char *f32_name = 0;
+  const char *cmp_name = 0;
+  const char *log_name = 0;
+
+  for (int a = 1; a < argc; a++) {
+    if (!strcmp(argv[a], "--pack") && a + 1 < argc) {
+      pack_name = argv[++a];
+    } else if (!strcmp(argv[a], "--csv") && a + 1 < argc) {
+      csv_name = argv[++a];
+    } else if (!strcmp(argv[a], "--f32") && a + 1 < argc) {
+      f32_name = argv[++a];
+    } else if (!strcmp(argv[a], "--compare") && a + 1 < argc) {
+      cmp_name = argv[++a];
+    } else if (!strcmp(argv[a], "--log") && a + 1 < argc) {
+      log_name = argv[++a];
+    } else if ((argv[a][0] != '-' || !strcmp(argv[a], "-")) && !stream_name) {
+      stream_name = argv[a];
+    } else {
+      usage();
+    }
+  }
+  if (!stream_name) usage();
+
+  if (pack_name) {
+    return pack(pack_name, stream_name);
+  }
+
+  FILE *stream = strcmp(stream_name, "-") ? fopen(stream_name, "rb") : stdin;
+  FILE *csv = csv_name ? fopen(csv_name, "w")  : 0;
+  FILE *f32 = f32_name ? fopen(f32_name, "wb") : 0;
+  FILE *cmp = cmp_name ? fopen(cmp_name, "rb") : 0;
+  FILE *log = log_name ? fopen(log_name, "wb") : 0;
+
+  if (!stream || (csv_name && !csv) || (f32_name && !f32) || (cmp_name && !cmp) || (log_name && !log)) {
+    fprintf(stderr, "mlxunpack: unable to open input or output file\n");
+    return 1;
+  }
+
+  static MLXPacketReader reader;
+  static mlx_RecordHeader header;
+  static mlx_RecordFrame frame; // the RAM image, kept from one subpage to the next as by MLX
+  static mlx_Parameters params;
+  static float T[768];          // ... and the frame, from zero as in MLX
+
+  bool bCalibrated = false;
+  size_t calibrations = 0;
+  size_t uncalibrated = 0;
+  size_t subpages = 0;
+  size_t gaps = 0;
+  size_t mismatched = 0;
+  size_t compared = 0;
+
+  for (;;) {
+    int c = fgetc(stream);
+    mlx_PacketType type = (c != EOF) ? reader.feed((uint8_t) c) : reader.flush();
+    if (c == EOF && type == MLX90640_PACKET_NONE) {
+      break;
+    }
+
+    if (type == MLX90640_PACKET_CALIBRATION) {
+      static mlx_RecordHeader latest;
+      reader.calibration(latest);
+      if (bCalibrated && !memcmp(latest.eeprom, header.eeprom, sizeof(header.eeprom)) && latest.address == header.address) {
+	continue; // the periodic re-send
+      }
+      if (bCalibrated && log) {
+	fprintf(stderr, "mlxunpack: calibration changed; the log keeps the first\n");
+      }
+      memcpy(&header, &latest, sizeof(header));
+
+      float scratch[768];
+      if (mlx_extract_parameters(header.eeprom, &params, scratch)) {
+	fprintf(stderr, "mlxunpack: calibration has bad pixels\n");
+      }
+      if (log && !bCalibrated) {
+	fwrite(&header, sizeof(header), 1, log);
+      }
+      bCalibrated = true;
+      ++calibrations;
+      continue;
+    }
+    if (type != MLX90640_PACKET_SUBPAGE) {
+      continue;
+    }
+    uint32_t previous = frame.sequence;
+    reader.subpage(frame);
+
+    if (!bCalibrated) {
+      ++uncalibrated;
+      continue;
+    }
+    if (subpages && frame.sequence != previous + 1) {
+      gaps += frame.sequence - previous - 1;
+    }
+    ++subpages;
+
+    mlx_calculate_temperatures(&params, frame.raw, mlx_control_mode(frame.control), mlx_control_resolution(frame.control),
+			       frame.subpage, T);
+
+    if (log) {
+      fwrite(&frame, sizeof(frame), 1, log);
+    }
+    if (csv) {
+      for (int row = 0; row < 24; row++) {
+	fprintf(csv, "%d", row);
+	for (int col = 0; col < 32; col++) {
+	  fprintf(csv, ",%.2f", T[row * 32 + col]);
+	}
+	fputc('\n', csv);
+      }
+    }
+    if (f32) {
+      fwrite(T, sizeof(float), 768, f32);
+    }
+    if (cmp) {
+      float ref[768];
+      if (fread(ref, sizeof(float), 768, cmp) != 768) {
+	fprintf(stderr, "mlxunpack: comparison file ends at subpage %lu\n", (unsigned long) (subpages - 1));
+	fclose(cmp);
+	cmp = 0;
+      } else {
+	++compared;
+	if (memcmp(ref, T, sizeof(ref))) {
+	  if (!mismatched) {
+	    fprintf(stderr, "mlxunpack: first mismatch at subpage %lu\n", (unsigned long) (subpages - 1));
+	  }
+	  ++mismatched;
+	}
+      }
+    }
+  }
+
+  fprintf(stderr, "mlxunpack: %lu packets (%lu calibrations, %lu subpages, %lu before calibration); %lu bad packets, %lu bytes skipped; %lu missing from the sequence\n",
+	  reader.packets(), (unsigned long) calibrations, (unsigned long) subpages, (unsigned long) uncalibrated,
+	  reader.errors(), reader.skipped(), (unsigned long) gaps);
+
+  if (cmp_name) {
+    fprintf(stderr, "mlxunpack: %lu of %lu subpages differ from %s\n",
+	    (unsigned long) mismatched, (unsigned long) compared, cmp_name);
+  }
+
+  if (stream != stdin) fclose(stream);
+  if (csv) fclose(csv);
+  if (f32) fclose(f32);
+  if (cmp) fclose(cmp);
+  if (log) fclose(log);
+
+  return mismatched ? 3 : 0;
+}